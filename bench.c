@@ -0,0 +1,310 @@
+/* bench.c
+   Benchmark driver for the Generic Iterator
+
+   Times each iterator operation on lists of 10^3 up to 10^max elements of
+   positiveIntType and stringType and prints one row per operation:
+
+      type,backend,size,op,ns_per_op,allocs_per_op,peak_rss_kb
+
+   An op is one call, except for advance, find and the int filters (findRange,
+   countRange, sumInts), where it is one element passed over, and freeIt, where
+   it is one element freed. The int filters are only timed for int types, next
+   to find's callback path. inlineInt is an inline iterator of ints, which only
+   the list backend has. Allocations are every malloc, calloc and realloc made
+   during the op, counted by the wrappers below. peak_rss_kb is the process's
+   high water mark so far (getrusage), so it only grows down the table.
+
+   reverse is timed from an end, from the middle and from a quarter of the
+   way in (reverseEnd, reverseMiddle, reverseQuarter), since only the last
+   has to move the cursor back to where it was.
+
+   usage: ./bench [-json] [-max 7] [-backend list|unrolled|tree], -max up to 8
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "iteratorG.h"
+#include "positiveIntType.h"
+#include "stringType.h"
+
+#define KEY_LEN 12
+#define ADVANCE_STEP 64
+#define REVERSE_SEEKS 64   /* reverse from an interior cursor seeks back to it, so it is timed fewer times */
+#define MAX_POW 8          /* 10^9 elements would take the size loop past INT_MAX */
+
+/* =====   Allocation counting  ===== */
+
+/* glibc's own allocator, which the wrappers below pass every call on to */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *p, size_t size);
+extern void  __libc_free(void *p);
+
+static unsigned long allocs;
+
+void *malloc(size_t size){
+   __atomic_fetch_add(&allocs, 1, __ATOMIC_RELAXED);
+   return __libc_malloc(size);
+}
+void *calloc(size_t n, size_t size){
+   __atomic_fetch_add(&allocs, 1, __ATOMIC_RELAXED);
+   return __libc_calloc(n, size);
+}
+void *realloc(void *p, size_t size){
+   __atomic_fetch_add(&allocs, 1, __ATOMIC_RELAXED);
+   return __libc_realloc(p, size);
+}
+void free(void *p){
+   __libc_free(p);
+}
+
+/* =====   Measuring  ===== */
+
+typedef struct Type {
+   char const *name;
+   ElmCompareFp cmp;
+   ElmNewFp new;
+   ElmFreeFp free;   /* new and free are NULL for inline ints, see build() */
+   char *keys;      /* element i is at keys + i * stride */
+   size_t stride;
+   int (*even)(void *vp);  /* the predicate find() is timed with, about half pass */
+} Type;
+
+static int json = 0;
+static int rows = 0;
+static char const *backendName = "list";
+static IteratorBackend backend = LIST_BACKEND;
+
+static double start;
+static unsigned long startAllocs;
+static volatile long sink;  /* keeps results the compiler would otherwise throw away */
+
+static double now(void){
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void begin(void){
+   startAllocs = __atomic_load_n(&allocs, __ATOMIC_RELAXED);
+   start = now();
+}
+
+static void report(Type *t, int n, char const *op, long ops){
+   double ns = now() - start;
+   unsigned long a = __atomic_load_n(&allocs, __ATOMIC_RELAXED) - startAllocs;
+   struct rusage ru;
+   getrusage(RUSAGE_SELF, &ru);
+   if(ops == 0) ops = 1;
+   if(json){
+      printf("%s  {\"type\": \"%s\", \"backend\": \"%s\", \"size\": %d, \"op\": \"%s\", "
+             "\"ns_per_op\": %.2f, \"allocs_per_op\": %.4f, \"peak_rss_kb\": %ld}",
+             rows > 0 ? ",\n" : "", t->name, backendName, n, op, ns / ops, (double) a / ops, ru.ru_maxrss);
+   }else{
+      printf("%s,%s,%d,%s,%.2f,%.4f,%ld\n", t->name, backendName, n, op, ns / ops, (double) a / ops, ru.ru_maxrss);
+   }
+   rows++;
+   fflush(stdout);
+}
+
+static int evenInt(void *vp){
+   return *(int *) vp % 2 == 0;
+}
+
+/* the keys are "k" and then a number */
+static int evenString(void *vp){
+   char const *s = vp;
+   return s[strlen(s) - 1] % 2 == 0;
+}
+
+static IteratorG build(Type *t, int n){
+   IteratorG it = (t->new == NULL) ? newIteratorInline(t->stride, t->cmp) : newIteratorBackend(backend, t->cmp, t->new, t->free);
+   int i;
+   for(i = 0; i < n; i++){
+      add(it, t->keys + i * t->stride);
+   }
+   return it;
+}
+
+static void benchSize(Type *t, int n){
+   int i;
+   long count;
+
+   begin();
+   IteratorG it = build(t, n);
+   report(t, n, "add", n);
+
+   reset(it);
+   begin();
+   for(count = 0; next(it) != NULL; count++);
+   report(t, n, "next", count);
+
+   begin();
+   for(count = 0; previous(it) != NULL; count++);
+   report(t, n, "previous", count);
+
+   /* from the middle, so nothing is at either end */
+   seek(it, n / 2);
+   begin();
+   for(i = 0; i < n; i++){
+      sink += distanceFromStart(it);
+   }
+   report(t, n, "distanceFromStart", n);
+
+   begin();
+   for(i = 0; i < n; i++){
+      sink += distanceToEnd(it);
+   }
+   report(t, n, "distanceToEnd", n);
+
+   /* each an even number of times, so it reads the same way round afterwards */
+   /* at an end the cursor just goes to the other end, in the middle the mirrored index is the same one */
+   seek(it, n);
+   begin();
+   for(i = 0; i < n - n % 2; i++){
+      reverse(it);
+   }
+   report(t, n, "reverseEnd", n - n % 2);
+
+   seek(it, n / 2);
+   begin();
+   for(i = 0; i < n - n % 2; i++){
+      reverse(it);
+   }
+   report(t, n, "reverseMiddle", n - n % 2);
+
+   /* anywhere else reverse() has to seek from the mirrored index back to this one */
+   seek(it, n / 4);
+   begin();
+   for(i = 0; i < REVERSE_SEEKS; i++){
+      reverse(it);
+   }
+   report(t, n, "reverseQuarter", REVERSE_SEEKS);
+
+   /* set replaces the same element over and over, each one a newElm and a freeElm */
+   reset(it);
+   next(it);
+   begin();
+   for(i = 0; i < n; i++){
+      set(it, t->keys + i * t->stride);
+   }
+   report(t, n, "set", n);
+
+   reset(it);
+   begin();
+   while(hasNext(it)){
+      /* advance() won't go past the end, so the last step is whatever is left */
+      int left = distanceToEnd(it);
+      freeIt(advance(it, left < ADVANCE_STEP ? left : ADVANCE_STEP));
+   }
+   report(t, n, "advance", n);
+
+   reset(it);
+   begin();
+   IteratorG found = find(it, t->even);
+   report(t, n, "find", n);
+   freeIt(found);
+
+   /* the same half of the elements as find, tested by the SIMD kernels instead of a callback */
+   if(t->even == evenInt){
+      reset(it);
+      begin();
+      found = findRange(it, 0, n / 2 - 1);
+      report(t, n, "findRange", n);
+      freeIt(found);
+
+      begin();
+      sink += countRange(it, 0, n / 2 - 1);
+      report(t, n, "countRange", n);
+
+      begin();
+      sink += sumInts(it);
+      report(t, n, "sumInts", n);
+   }
+
+   /* del removes the element behind the cursor, so start at the end */
+   seek(it, n);
+   begin();
+   for(count = 0; del(it); count++);
+   report(t, n, "del", count);
+   freeIt(it);
+
+   it = build(t, n);
+   begin();
+   freeIt(it);
+   report(t, n, "freeIt", n);
+}
+
+int main(int argc, char *argv[])
+{
+   int max = 7;
+   int i;
+   for(i = 1; i < argc; i++){
+      if(strcmp(argv[i], "-json") == 0){
+         json = 1;
+      }else if(strcmp(argv[i], "-max") == 0 && i + 1 < argc){
+         max = atoi(argv[++i]);
+      }else if(strcmp(argv[i], "-backend") == 0 && i + 1 < argc){
+         backendName = argv[++i];
+         if(strcmp(backendName, "unrolled") == 0){
+            backend = UNROLLED_BACKEND;
+         }else if(strcmp(backendName, "tree") == 0){
+            backend = TREE_BACKEND;
+         }else{
+            backendName = "list";
+         }
+      }else{
+         fprintf(stderr, "usage: %s [-json] [-max 7] [-backend list|unrolled|tree]\n", argv[0]);
+         return EXIT_FAILURE;
+      }
+   }
+   if(max < 3) max = 3;
+   if(max > MAX_POW){
+      fprintf(stderr, "Error -- -max can be at most %d\n", MAX_POW);
+      return EXIT_FAILURE;
+   }
+
+   int largest = 1;
+   for(i = 0; i < max; i++){
+      largest *= 10;
+   }
+   /* the elements are made up front so building them isn't timed */
+   int *ints = __libc_malloc(largest * sizeof(int));
+   char *strings = __libc_malloc((size_t) largest * KEY_LEN);
+   if(ints == NULL || strings == NULL){
+      fprintf(stderr, "Error -- not enough memory for 10^%d elements\n", max);
+      return EXIT_FAILURE;
+   }
+   for(i = 0; i < largest; i++){
+      /* shuffled a little so the values don't come in order */
+      unsigned v = (unsigned) i * 2654435761u;
+      ints[i] = v % largest;
+      snprintf(strings + (size_t) i * KEY_LEN, KEY_LEN, "k%u", v % largest);
+   }
+   Type types[3] = {
+      { "positiveInt", positiveIntCompare, positiveIntNew, positiveIntFree, (char *) ints, sizeof(int), evenInt },
+      { "string", stringCompare, stringNew, stringFree, strings, KEY_LEN, evenString },
+      { "inlineInt", positiveIntCompare, NULL, NULL, (char *) ints, sizeof(int), evenInt },
+   };
+   int ntypes = (backend == LIST_BACKEND) ? 3 : 2;
+
+   if(json){
+      printf("[\n");
+   }else{
+      printf("type,backend,size,op,ns_per_op,allocs_per_op,peak_rss_kb\n");
+   }
+   int t, n;
+   for(t = 0; t < ntypes; t++){
+      for(n = 1000; n <= largest; n *= 10){
+         benchSize(&types[t], n);
+      }
+   }
+   if(json) printf("\n]\n");
+
+   __libc_free(ints);
+   __libc_free(strings);
+   return EXIT_SUCCESS;
+}
@@ -4,299 +4,1401 @@
    Written by: Jonathan Williams z5162987
    Date: April 2018
 
-
+   The public functions below work through the IteratorOps of whichever backend the
+   iterator was created with. The doubly linked list backend lives in this file, the
+   others have a file of their own (see iteratorGRep.h).
 */
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
 #include "iteratorG.h"
+#include "iteratorGRep.h"
 #include <unistd.h> 
 #include <math.h>
+#include <pthread.h>
+#include <time.h>
 
 typedef struct Node {
    void* data;
-   struct Node* prev;
-   struct Node* next;
+   struct Node* link[2];  //link[PREV] and link[NEXT]
+   char payload[];  //holds the element itself for iterators made with newIteratorInline
   
 } Node;
 
-typedef struct IteratorGRep {
-   Node* curs;  //curs is used to keep track of the cursor, it will be infront of the cursor at all times
-   
+//nodes are carved out of slabs owned by the iterator rather than malloc'd one at a time
+//the first slab holds POOL_MIN_SLAB nodes and each new slab doubles in size up to POOL_MAX_SLAB
+#define POOL_MIN_SLAB 8
+#define POOL_MAX_SLAB 4096
+
+//strings shorter than this are kept in the nodes of iterators made with newIteratorStrings
+#define SMALL_STRING 24
+
+typedef struct Slab {
+   struct Slab* next;
+   char mem[];      //cap nodes of nodeSize bytes each
+} Slab;
+
+typedef struct NodePool {
+   Slab* slabs;     //every slab allocated so far, newest first
+   Node* free;      //nodes returned by del(), chained through link[NEXT]
+   size_t nodeSize; //sizeof(Node) plus the inline payload, rounded up to keep nodes aligned
+   int used;        //number of nodes handed out from the newest slab
+   int cap;         //number of nodes in the newest slab
+} NodePool;
+
+typedef struct ListStore {
    //empty nodes used to keep track of the cursor when at position 0, 1, n and n+1   
    Node* mtstart; 
    Node* mtend;
    
-   ElmCompareFp cmpElm;
-   ElmNewFp newElm;
-   ElmFreeFp freeElm;
+   NodePool pool;
+} ListStore;
 
-} IteratorGRep;
+//for the list backend the cursor's Pos.node is the node infront of the cursor at all times
+//links and data that readers of a concurrent list might be following are stored with release,
+//so a node is filled in before anyone can reach it (see makeConcurrent())
 
 
-IteratorG newIterator(ElmCompareFp cmpFp, ElmNewFp newFp, ElmFreeFp freeFp){
+static Node* poolAlloc(IteratorG it, NodePool* pool){
+   Node* new;
+   //recycle a deleted node before touching the slabs
+   if(pool->free != NULL){
+      new = pool->free;
+      pool->free = new->link[NEXT];
+      return new;
+   }
+   //the newest slab is used up, so grab another one twice its size
+   if(pool->used == pool->cap){
+      int cap = (pool->cap == 0) ? POOL_MIN_SLAB : pool->cap * 2;
+      if(cap > POOL_MAX_SLAB) cap = POOL_MAX_SLAB;
+      Slab* slab = malloc(sizeof(Slab) + cap * pool->nodeSize);
+      if(slab == NULL) return NULL;
+      STAT(it, nodeMallocs, 1);
+      slab->next = pool->slabs;
+      pool->slabs = slab;
+      pool->used = 0;
+      pool->cap = cap;
+   }
+   return (Node*) (pool->slabs->mem + pool->nodeSize * pool->used++);
+}
+
+//n nodes in one contiguous run, carved from the newest slab if they fit or else given a slab of their own
+static Node* poolAllocMany(IteratorG it, NodePool* pool, int n){
+   if(pool->cap - pool->used >= n){
+      Node* first = (Node*) (pool->slabs->mem + pool->nodeSize * pool->used);
+      pool->used += n;
+      return first;
+   }
+   Slab* slab = malloc(sizeof(Slab) + n * pool->nodeSize);
+   if(slab == NULL) return NULL;
+   STAT(it, nodeMallocs, 1);
+   //the run's slab goes second in the list so what is left of the newest slab still gets used
+   slab->next = pool->slabs->next;
+   pool->slabs->next = slab;
+   return (Node*) slab->mem;
+}
+
+static void poolFree(NodePool* pool, Node* old){
+   old->link[NEXT] = pool->free;
+   pool->free = old;
+}
+
+static void poolDestroy(NodePool* pool){
+   Slab* slab = pool->slabs;
+   while(slab != NULL){
+      Slab* tmp = slab->next;
+      free(slab);
+      slab = tmp;
+   }
+   pool->slabs = NULL;
+   pool->free = NULL;
+   pool->used = pool->cap = 0;
+}
+
+
+/* =====   List backend  ===== */
+
+static int listInit(IteratorG it){
+   ListStore* ls = malloc(sizeof(ListStore));
+   if(ls == NULL) return 0;
+   ls->pool.slabs = NULL;
+   ls->pool.free = NULL;
+   ls->pool.nodeSize = (sizeof(Node) + it->elemSize + sizeof(void*) - 1) / sizeof(void*) * sizeof(void*);
+   ls->pool.used = ls->pool.cap = 0;
+   //establish an 'empty' list with nodes mtend and mtstart, the cursor will be infront of mtend
+   //the two sentinels are the first nodes of the first slab
+   ls->mtstart = poolAlloc(it, &ls->pool);
+   ls->mtend = poolAlloc(it, &ls->pool);
+   if(ls->mtstart == NULL || ls->mtend == NULL){
+      poolDestroy(&ls->pool);
+      free(ls);
+      return 0;
+   }
+   ls->mtstart->data = NULL;
+   ls->mtend->data = NULL;       
+   STAT(it, nodesAllocated, 2);
+   STAT(it, bytesInUse, 2 * ls->pool.nodeSize);
+
+   ls->mtend->link[NEXT] = NULL;
+   ls->mtstart->link[PREV] = NULL;
+    
+   ls->mtstart->link[NEXT] = ls->mtend;
+   ls->mtend->link[PREV] = ls->mtstart;
+   //at this moment the list should look like:  {mtstart}-> ^ <-{mtend}
+   it->store = ls;
+   return 1;
+}
+
+//whether the element using slot was made by newElm, rather than living in a list node's payload
+static int ownsHeap(IteratorG it, void** slot){
+   //only list nodes have a payload, and data is the first member of a Node
+   return it->elemSize == 0 || *slot != ((Node*) slot)->payload;
+}
+
+static void listDestroy(IteratorG it){
+   ListStore* ls = it->store;
+   if(it->freeElm != NULL){
+      Node* tmp = ls->mtstart->link[NEXT];
+      while(tmp != ls->mtend){
+         if(ownsHeap(it, &tmp->data)) callFree(it, tmp->data);
+         tmp = tmp->link[NEXT];
+      }
+   }
+   //every node, sentinels included, lives in the pool so the slabs go in one sweep
+   STAT(it, nodesFreed, it->size + 2);
+   STAT(it, bytesInUse, -(long) (it->size + 2) * ls->pool.nodeSize);
+   poolDestroy(&ls->pool);
+   free(ls);
+}
+
+static Pos listEnd(IteratorG it, int d){
+   ListStore* ls = it->store;
+   Pos p = { (d == NEXT) ? ls->mtend : ls->mtstart->link[NEXT], 0 };
+   return p;
+}
+
+static void** listSlot(IteratorG it, Pos p, int d){
+   ListStore* ls = it->store;
+   Node* n = (d == NEXT) ? p.node : ((Node*) p.node)->link[PREV];
+   if(n == ls->mtend || n == ls->mtstart) return NULL;
+   return &n->data;
+}
+
+static void* listStep(IteratorG it, Pos* p, int d){
+   Node* n = p->node;
+   STAT(it, hops, 1);
+   if(d == NEXT){
+      p->node = n->link[NEXT];
+      return n->data;
+   }
+   p->node = n->link[PREV];
+   return ((Node*) p->node)->data;
+}
+
+//store a copy of vp in node n, either in its payload or through newElm
+static void listCopyElm(IteratorG it, Node* n, void const *vp){
+   if(it->elemSize > 0 && it->newElm == NULL){
+      memcpy(n->payload, vp, it->elemSize);
+      n->data = n->payload;
+   }else if(it->elemSize > 0 && strlen(vp) < it->elemSize){
+      strcpy(n->payload, vp);
+      n->data = n->payload;
+   }else{
+      n->data = callNew(it, vp);
+   }
+}
+
+static int listInsert(IteratorG it, Pos* p, int d, void *vp){
+   ListStore* ls = it->store;
+   Node* curs = p->node;
+   Node* new = poolAlloc(it, &ls->pool);
+   if(new == NULL) return 0;
+   STAT(it, nodesAllocated, 1);
+   STAT(it, bytesInUse, ls->pool.nodeSize);
+   listCopyElm(it, new, vp);
+   
+   //insert new node into the list
+   Node* left = curs->link[PREV];
+   new->link[PREV] = left;
+   new->link[NEXT] = curs;
+   __atomic_store_n(&left->link[NEXT], new, __ATOMIC_RELEASE);
+   __atomic_store_n(&curs->link[PREV], new, __ATOMIC_RELEASE);
+   
+   //inserting on the NEXT side leaves the cursor behind the new node
+   if(d == NEXT) p->node = new;
+   return 1;
+}
+
+static int listInsertMany(IteratorG it, Pos* p, int d, void const *array, int n, size_t stride){
+   ListStore* ls = it->store;
+   Node* curs = p->node;
+   Node* block = poolAllocMany(it, &ls->pool, n);
+   if(block == NULL) return 0;
+   STAT(it, nodesAllocated, n);
+   STAT(it, bytesInUse, n * ls->pool.nodeSize);
+   //the block is linked in memory order, so a walk through the new elements reads it front to back
+   //inserting on the NEXT side one at a time leaves them in reverse, so the last element comes first
+   Node* first = curs->link[PREV];
+   Node* left = first;
+   int k;
+   for(k = 0; k < n; k++){
+      Node* new = (Node*) ((char*) block + ls->pool.nodeSize * k);
+      int i = (d == NEXT) ? n - 1 - k : k;
+      listCopyElm(it, new, (char const *) array + stride * i);
+      if(k > 0) left->link[NEXT] = new;
+      new->link[PREV] = left;
+      left = new;
+   }
+   left->link[NEXT] = curs;
+   __atomic_store_n(&first->link[NEXT], block, __ATOMIC_RELEASE);
+   __atomic_store_n(&curs->link[PREV], left, __ATOMIC_RELEASE);
+   if(d == NEXT) p->node = block;
+   return 1;
+}
+
+static void reclaimNode(IteratorG it, void* n){
+   ListStore* ls = it->store;
+   poolFree(&ls->pool, n);
+}
+
+static void* listRemove(IteratorG it, Pos* p, int d){
+   ListStore* ls = it->store;
+   Node* curs = p->node;
+   Node* tmp = (d == NEXT) ? curs : curs->link[PREV];
+   void* data = tmp->data;
+   //unplug node, its own links are left alone for any reader still on it
+   __atomic_store_n(&tmp->link[PREV]->link[NEXT], tmp->link[NEXT], __ATOMIC_RELEASE);
+   __atomic_store_n(&tmp->link[NEXT]->link[PREV], tmp->link[PREV], __ATOMIC_RELEASE);
+   if(d == NEXT) p->node = tmp->link[NEXT];
+   STAT(it, nodesFreed, 1);
+   STAT(it, bytesInUse, -(long) ls->pool.nodeSize);
+   //hand the node back to the pool, once no reader can reach it if the list is concurrent
+   if(it->rcu != NULL){
+      rcuRetire(it, tmp, reclaimNode);
+   }else{
+      poolFree(&ls->pool, tmp);
+   }
+   return data;
+}
+
+static Pos listLocate(IteratorG it, void** slot){
+   //data is the first member of a Node
+   Pos p = { (Node*) slot, 0 };
+   return p;
+}
+
+static void listGather(IteratorG it, Pos* p, int d, void** out, int n){
+   Node* curs = p->node;
+   int i;
+   STAT(it, hops, n);
+   if(d == NEXT){
+      for(i = 0; i < n; i++){
+         out[i] = curs->data;
+         curs = curs->link[NEXT];
+      }
+   }else{
+      for(i = 0; i < n; i++){
+         curs = curs->link[PREV];
+         out[i] = curs->data;
+      }
+   }
+   p->node = curs;
+}
+
+static int listSpan(IteratorG it, Pos* p, int d, int n, char const **base, long* stride){
+   ListStore* ls = it->store;
+   if(it->elemSize == 0 || it->newElm != NULL || n <= 0) return 0;
+   Node* first = (d == NEXT) ? p->node : ((Node*) p->node)->link[PREV];
+   //nodes made one after another sit next to each other in their slab, in memory order or the reverse
+   long step = (long) ls->pool.nodeSize;
+   if(n > 1 && (char*) first->link[d] != (char*) first + step) step = -step;
+   //the next node's address is worked out rather than loaded, so the checks don't wait on each other
+   Node* last = first;
+   int k;
+   for(k = 1; k < n && (char*) last->link[d] == (char*) last + step; k++){
+      last = (Node*) ((char*) last + step);
+   }
+   STAT(it, hops, k);
+   p->node = (d == NEXT) ? last->link[NEXT] : last;
+   *base = first->payload;
+   *stride = step;
+   return k;
+}
+
+//while sorting, the nodes form NULL terminated chains through link[d] alone, in reading order
+typedef struct ChainJob {
+   IteratorG it;
+   int d;
+   Node* head;
+   int n;
+   Node* other;  //for merge jobs, the chain merged into head
+} ChainJob;
+
+//a stable merge, a's nodes go first among equal elements
+static Node* mergeChains(IteratorG it, Node* a, Node* b, int d){
+   Node* first = NULL;
+   Node** tail = &first;
+   while(a != NULL && b != NULL){
+      if(callCmp(it, b->data, a->data) < 0){
+         *tail = b;
+         b = b->link[d];
+      }else{
+         *tail = a;
+         a = a->link[d];
+      }
+      tail = &(*tail)->link[d];
+   }
+   *tail = (a != NULL) ? a : b;
+   return first;
+}
+
+static Node* sortChain(IteratorG it, Node* head, int n, int d){
+   if(n <= 1) return head;
+   //cut the chain after its first half
+   Node* last = head;
+   int i;
+   for(i = 1; i < n / 2; i++){
+      last = last->link[d];
+   }
+   Node* second = last->link[d];
+   last->link[d] = NULL;
+   return mergeChains(it, sortChain(it, head, n / 2, d), sortChain(it, second, n - n / 2, d), d);
+}
+
+static void* sortChainJob(void* arg){
+   ChainJob* job = arg;
+   job->head = sortChain(job->it, job->head, job->n, job->d);
+   return NULL;
+}
+
+static void* mergeChainJob(void* arg){
+   ChainJob* job = arg;
+   job->head = mergeChains(job->it, job->head, job->other, job->d);
+   return NULL;
+}
+
+//no element moves, the nodes are unhooked into chains, sorted and hooked back in order
+static int listSort(IteratorG it, int d, int nthreads){
+   ListStore* ls = it->store;
+   Node* ends[2] = { ls->mtstart, ls->mtend };
+   int n = it->size;
+   if(n < 2) return 1;
+   if(nthreads > n) nthreads = n;
+   ChainJob* jobs = malloc(nthreads * sizeof(ChainJob));
+   if(jobs == NULL) return 0;
+
+   //cut the list into nthreads chains of about the same length, each sorted on its own thread
+   Node* n0 = ends[!d]->link[d];
+   int k;
+   for(k = 0; k < nthreads; k++){
+      jobs[k].it = it;
+      jobs[k].d = d;
+      jobs[k].head = n0;
+      jobs[k].n = n / nthreads + (k < n % nthreads);
+      int i;
+      for(i = 1; i < jobs[k].n; i++){
+         n0 = n0->link[d];
+      }
+      Node* last = n0;
+      n0 = last->link[d];
+      last->link[d] = NULL;
+   }
+   runJobs(sortChainJob, jobs, sizeof(ChainJob), nthreads);
+
+   //then merge neighbouring chains in pairs, every pair in a round at once
+   int runs = nthreads;
+   while(runs > 1){
+      int pairs = runs / 2;
+      for(k = 0; k < pairs; k++){
+         jobs[k] = jobs[2 * k];
+         jobs[k].other = jobs[2 * k + 1].head;
+      }
+      runJobs(mergeChainJob, jobs, sizeof(ChainJob), pairs);
+      //an odd chain out waits for the next round
+      if(runs % 2 == 1) jobs[pairs] = jobs[runs - 1];
+      runs = pairs + runs % 2;
+   }
+
+   //hook the chain back between the sentinels, restoring the links the other way
+   Node* prev = ends[!d];
+   Node* cur;
+   for(cur = jobs[0].head; cur != NULL; cur = cur->link[d]){
+      prev->link[d] = cur;
+      cur->link[!d] = prev;
+      prev = cur;
+   }
+   prev->link[d] = ends[d];
+   ends[d]->link[!d] = prev;
+   free(jobs);
+   return 1;
+}
+
+static const IteratorOps listOps = {
+   listInit, listDestroy, listEnd, listSlot, listStep, listInsert, listInsertMany, listRemove,
+   NULL, NULL, NULL, listLocate, listGather, listSort, listSpan
+};
+
+
+/* =====   Iterator functions  ===== */
+
+//STAT_TIME(it, op) at the top of a function adds the time until it returns to it's latency histogram for op
+#ifdef ITERATORG_STATS
+typedef struct StatTimer {
+   IteratorG it;  //NULL when another iterator function is already being timed
+   int op;
+   struct timespec start;
+} StatTimer;
+
+static __thread int statDepth;
+
+static StatTimer statStart(IteratorG it, int op){
+   StatTimer t = { (statDepth++ == 0) ? it : NULL, op };
+   if(t.it != NULL) clock_gettime(CLOCK_MONOTONIC, &t.start);
+   return t;
+}
+
+static void statStop(StatTimer* t){
+   statDepth--;
+   if(t->it == NULL) return;
+   struct timespec end;
+   clock_gettime(CLOCK_MONOTONIC, &end);
+   long long ns = (end.tv_sec - t->start.tv_sec) * 1000000000LL + (end.tv_nsec - t->start.tv_nsec);
+   int b = 63 - __builtin_clzll(ns | 1);
+   if(b >= STAT_BUCKETS) b = STAT_BUCKETS - 1;
+   STAT(t->it, calls[t->op], 1);
+   STAT(t->it, latency[t->op][b], 1);
+}
+
+#define STAT_TIME(it, op) StatTimer statTimer __attribute__((cleanup(statStop))) = statStart(it, op)
+#else
+#define STAT_TIME(it, op) ((void) 0)
+#endif
+
+static IteratorBackend defaultBackend = LIST_BACKEND;
+
+static const IteratorOps* backendOps(IteratorBackend backend){
+   switch(backend){
+      case UNROLLED_BACKEND: return &unrolledOps;
+      case TREE_BACKEND: return &treeOps;
+      default: return &listOps;
+   }
+}
+
+static IteratorG newIteratorRep(const IteratorOps* ops, ElmCompareFp cmpFp, ElmNewFp newFp, ElmFreeFp freeFp, size_t elemSize){
    IteratorG newIt;
    newIt = malloc(sizeof(struct IteratorGRep));
    assert (newIt != NULL);
-   //establish an 'empty' newIterator with nodes mtend and mtstart, curs will point at mtstart
-   newIt->mtstart = malloc(sizeof(struct Node));
-   newIt->mtstart->data = NULL;
-   newIt->mtend = malloc(sizeof(struct Node));
-   newIt->mtend->data = NULL;       
-
-   newIt->mtend->next = NULL;
-   newIt->mtstart->prev = NULL;
-    
-   newIt->mtstart->next = newIt->mtend;
-   newIt->mtend->prev = newIt->mtstart;
-   newIt->curs = newIt->mtend;
-   //at this moment newIt should look like:  {mtstart}-> ^ <-{mtend}(<-curs)
-   
+   newIt->ops = ops;
    newIt->cmpElm = cmpFp;
    newIt->newElm = newFp;
    newIt->freeElm = freeFp;
+   newIt->elemSize = elemSize;
+#ifdef ITERATORG_STATS
+   newIt->stats = calloc(1, sizeof(IteratorStats));
+   assert (newIt->stats != NULL);
+#endif
+   if(!ops->init(newIt)){
+#ifdef ITERATORG_STATS
+      free(newIt->stats);
+#endif
+      free(newIt);
+      return NULL;
+   }
+   newIt->curs = ops->end(newIt, NEXT);
+   newIt->size = newIt->index = 0;
+   newIt->fwd = NEXT;
+   newIt->sorted = 0;
+   newIt->view = 0;
+   newIt->filtered = 0;
+   newIt->hash = NULL;
+   newIt->rcu = NULL;
+   newIt->staging = NULL;
    return newIt;
 
 }
 
+IteratorG newIterator(ElmCompareFp cmpFp, ElmNewFp newFp, ElmFreeFp freeFp){
+   return newIteratorRep(backendOps(defaultBackend), cmpFp, newFp, freeFp, 0);
+}
+
+IteratorG newIteratorBackend(IteratorBackend backend, ElmCompareFp cmpFp, ElmNewFp newFp, ElmFreeFp freeFp){
+   return newIteratorRep(backendOps(backend), cmpFp, newFp, freeFp, 0);
+}
+
+void setDefaultBackend(IteratorBackend backend){
+   defaultBackend = backend;
+}
+
+IteratorG newIteratorFromArray(void const *array, size_t n, size_t stride, ElmCompareFp cmpFp, ElmNewFp newFp, ElmFreeFp freeFp){
+   IteratorG newIt = newIterator(cmpFp, newFp, freeFp);
+   if(newIt != NULL && !addMany(newIt, array, n, stride)){
+      freeIt(newIt);
+      return NULL;
+   }
+   return newIt;
+}
+
+IteratorG newIteratorSorted(ElmCompareFp cmpFp, ElmNewFp newFp, ElmFreeFp freeFp){
+   //the tree backend can search by value once its list order is kept sorted
+   IteratorG newIt = newIteratorRep(&treeOps, cmpFp, newFp, freeFp, 0);
+   if(newIt != NULL) newIt->sorted = 1;
+   return newIt;
+}
+
+IteratorG newIteratorLike(IteratorG it){
+   const IteratorOps* ops = (it->ops->insert != NULL) ? it->ops : &listOps;
+   return newIteratorRep(ops, it->cmpElm, it->newElm, it->freeElm, it->elemSize);
+}
+
+IteratorG loadIterator(char const *path, ElmCompareFp cmpFp, ElmNewFp newFp, ElmFreeFp freeFp){
+   IteratorG newIt = newIteratorRep(&mappedOps, cmpFp, newFp, freeFp, 0);
+   if(newIt == NULL) return NULL;
+   if(!mappedOpen(newIt, path)){
+      freeIt(newIt);
+      return NULL;
+   }
+   //the cursor was put at the end while the store was empty, which is now the start
+   newIt->size = newIt->ops->rank(newIt, newIt->ops->end(newIt, NEXT));
+   return newIt;
+}
+
+IteratorG newIteratorStrings(ElmCompareFp cmpFp, ElmNewFp newFp, ElmFreeFp freeFp){
+   return newIteratorRep(&listOps, cmpFp, newFp, freeFp, SMALL_STRING);
+}
+
+IteratorG newIteratorInline(size_t elemSize, ElmCompareFp cmpFp){
+   assert (elemSize > 0);
+   //only the list backend stores elements inside its nodes
+   return newIteratorRep(&listOps, cmpFp, NULL, NULL, elemSize);
+}
+
+//where reset() puts the cursor, a view's ends are fixed when advance() makes it
+static Pos endOf(IteratorG it, int d){
+   return it->view ? it->vends[d] : it->ops->end(it, d);
+}
+
+static int passes(IteratorG it, void* data){
+   int i;
+   for(i = 0; i < it->filt.npreds; i++){
+      STAT(it, predCalls, 1);
+      if(!it->filt.preds[i](data)) return 0;
+   }
+   return 1;
+}
+
+//look for the closest match ahead of (dir 1) or behind (dir 0) a filter's cursor without moving it
+//the result is remembered until the cursor moves, so asking twice costs nothing
+static int filterLook(IteratorG it, int dir){
+   Filter* f = &it->filt;
+   if(f->lookDir == dir) return f->found;
+   Pos p = it->curs;
+   int raw = f->raw;
+   int d = dir ? it->fwd : !it->fwd;
+   f->lookDir = dir;
+   f->found = 0;
+   while(dir ? raw < f->rawSize : raw > 0){
+      void* data = it->ops->step(it, &p, d);
+      raw += dir ? 1 : -1;
+      if(passes(it, data)){
+         f->found = 1;
+         f->look = p;
+         f->lookRaw = raw;
+         f->lookData = data;
+         break;
+      }
+   }
+   return f->found;
+}
+
+static void* filterMove(IteratorG it, int dir){
+   Filter* f = &it->filt;
+   if(!filterLook(it, dir)) return NULL;
+   it->curs = f->look;
+   f->raw = f->lookRaw;
+   f->lookDir = -1;
+   if(it->index >= 0) it->index += dir ? 1 : -1;
+   return f->lookData;
+}
+
+//number of matches between a filter's cursor and the end of its range in direction dir
+static int filterCount(IteratorG it, int dir){
+   struct IteratorGRep walker = *it;
+   int count = 0;
+   while(filterMove(&walker, dir) != NULL){
+      count++;
+   }
+   return count;
+}
+
+static int (**copyPreds(IteratorG it, int extra))(void *vp){
+   int n = it->filtered ? it->filt.npreds : 0;
+   int (**preds)(void *vp) = malloc((n + extra) * sizeof(*preds));
+   assert (preds != NULL);
+   if(n > 0) memcpy(preds, it->filt.preds, n * sizeof(*preds));
+   return preds;
+}
+
+IteratorG filter(IteratorG it, int (*fp) (void *vp) ){
+   IteratorG filtnew = malloc(sizeof(struct IteratorGRep));
+   assert (filtnew != NULL);
+   *filtnew = *it;
+   //views can't take sorted inserts, so they are plain lists
+   filtnew->sorted = 0;
+   filtnew->hash = NULL;
+   filtnew->rcu = NULL;
+   filtnew->staging = NULL;
+   //the range is whatever it still has ahead of its cursor, read in the same direction
+   filtnew->view = 1;
+   filtnew->vends[!it->fwd] = it->curs;
+   filtnew->vends[it->fwd] = endOf(it, it->fwd);
+   filtnew->filt.rawSize = it->filtered ? it->filt.rawSize - it->filt.raw : it->size - distanceFromStart(it);
+   filtnew->filt.raw = 0;
+   filtnew->filt.lookDir = -1;
+   //filtering a filter tests its predicates first, then fp
+   filtnew->filt.preds = copyPreds(it, 1);
+   filtnew->filt.npreds = (it->filtered ? it->filt.npreds : 0) + 1;
+   filtnew->filt.preds[filtnew->filt.npreds - 1] = fp;
+   filtnew->filtered = 1;
+   filtnew->index = 0;
+   filtnew->size = -1;
+   return filtnew;
+}
+
+//iterators loaded with loadIterator() can't be changed, though views of them can once materialized
+static int readOnly(IteratorG it){
+   return it->ops->insert == NULL;
+}
+
+int materialize(IteratorG it){
+   if(!it->view) return 1;
+   //copy the elements the view borrows, in the order it reads them, into a store of its own
+   int index = distanceFromStart(it);
+   struct IteratorGRep orig = *it;
+   struct IteratorGRep src = *it;
+   reset(&src);
+   //a read only store can't be built up, so the copy goes in a list
+   if(it->ops->insert == NULL) it->ops = &listOps;
+#ifdef ITERATORG_STATS
+   //the copy is a list of its own now, so it stops counting towards the one it came from
+   it->stats = calloc(1, sizeof(IteratorStats));
+   if(it->stats == NULL){
+      *it = orig;
+      return 0;
+   }
+#endif
+   if(!it->ops->init(it)){
+#ifdef ITERATORG_STATS
+      free(it->stats);
+#endif
+      *it = orig;
+      return 0;
+   }
+   it->view = 0;
+   it->filtered = 0;
+   it->fwd = NEXT;
+   it->curs = it->ops->end(it, NEXT);
+   it->size = 0;
+   while(hasNext(&src)){
+      //inserting on the PREV side leaves the cursor after the new element, so the list is built in order
+      if(!it->ops->insert(it, &it->curs, PREV, next(&src))){
+         it->ops->destroy(it);
+#ifdef ITERATORG_STATS
+         free(it->stats);
+#endif
+         *it = orig;
+         return 0;
+      }
+      it->size++;
+   }
+   if(orig.filtered) free(orig.filt.preds);
+   //put the cursor back at the same index
+   it->curs = it->ops->end(it, PREV);
+   for(it->index = 0; it->index < index; it->index++){
+      it->ops->step(it, &it->curs, NEXT);
+   }
+   return 1;
+}
+
 int  add(IteratorG it, void *vp){
-   Node* new = malloc(sizeof(Node));
-   if(new == NULL){
+   STAT_TIME(it, STAT_ADD);
+   if(it->view && !materialize(it)) return 0;
+   if(readOnly(it)) return 0;
+   if(it->sorted) return insertSorted(it, vp);
+   //the index entry is made first, so a full index can't leave an element unindexed
+   if(it->hash != NULL && !hashReserve(it)) return 0;
+   if(!it->ops->insert(it, &it->curs, it->fwd, vp)){
       fprintf(stderr, "Error -- unable to add new node");
       return 0;
    }
-   new->data = it->newElm(vp);
-   
-   //insert new node into the list
-   it->curs->prev->next = new;
-   new->prev = it->curs->prev;
-   it->curs->prev = new;
-   new->next = it->curs;
-   
-   //ensure that the cursor is behing it->curs
-   it->curs = new;
-   
+   it->size++;
+   if(it->hash != NULL) hashAdd(it, it->ops->slot(it, it->curs, it->fwd));
    return 1;
    
 }
+//addOwned() hands the backend the caller's element where add() would make a copy
+static void* ownElm(void const *vp){
+   return (void*) vp;
+}
+
+int  addOwned(IteratorG it, void *vp){
+   //elements copied into their nodes have no pointer to adopt
+   if(it->elemSize > 0 && it->newElm == NULL) return 0;
+   if(it->view && !materialize(it)) return 0;
+   //newElm is swapped on a copy of the iterator, since stage() may be calling it's newElm on another thread
+   struct IteratorGRep walker = *it;
+   walker.newElm = ownElm;
+   if(!add(&walker, vp)) return 0;
+   it->curs = walker.curs;
+   it->size = walker.size;
+   it->index = walker.index;
+   //short strings are copied into their node all the same, so vp isn't needed any more
+   if(it->elemSize > 0 && strlen(vp) < it->elemSize) callFree(it, vp);
+   return 1;
+}
+//the index of the cursor if it were at physical position p
+static int indexOf(IteratorG it, Pos p){
+   int r = it->ops->rank(it, p);
+   return (it->fwd == NEXT) ? r : it->size - r;
+}
+
+int  insertSorted(IteratorG it, void *vp){
+   if(!it->sorted) return 0;
+   //equal elements are kept in the order they were added
+   Pos p = it->ops->bound(it, vp, 1);
+   if(it->hash != NULL && !hashReserve(it)) return 0;
+   if(!it->ops->insert(it, &p, it->fwd, vp)){
+      fprintf(stderr, "Error -- unable to add new node");
+      return 0;
+   }
+   it->size++;
+   if(it->hash != NULL) hashAdd(it, it->ops->slot(it, p, it->fwd));
+   it->curs = p;
+   it->index = indexOf(it, p);
+   return 1;
+}
+//a reversed list reads descending, so its lower bound is the first element not greater than key
+int  lowerBound(IteratorG it, void *key){
+   if(!it->sorted) return -1;
+   return indexOf(it, it->ops->bound(it, key, it->fwd == PREV));
+}
+int  seekTo(IteratorG it, void *key){
+   if(!it->sorted) return 0;
+   it->curs = it->ops->bound(it, key, it->fwd == PREV);
+   it->index = indexOf(it, it->curs);
+   void** slot = it->ops->slot(it, it->curs, it->fwd);
+   return slot != NULL && callCmp(it, *slot, key) == 0;
+}
+int  contains(IteratorG it, void *key){
+   if(!it->sorted) return 0;
+   void** slot = it->ops->slot(it, it->ops->bound(it, key, 0), NEXT);
+   return slot != NULL && callCmp(it, *slot, key) == 0;
+}
+int  attachHashIndex(IteratorG it, ElmHashFp hashFp){
+   if(it->view || it->ops->locate == NULL) return 0;
+   HashIndex* h = newHashIndex(hashFp);
+   if(h == NULL) return 0;
+   HashIndex* old = it->hash;
+   it->hash = h;
+   Pos p = it->ops->end(it, !it->fwd);
+   void** slot;
+   while((slot = it->ops->slot(it, p, it->fwd)) != NULL){
+      if(!hashReserve(it)){
+         //keep whatever index it had before
+         freeHashIndex(h);
+         it->hash = old;
+         return 0;
+      }
+      hashAdd(it, slot);
+      it->ops->step(it, &p, it->fwd);
+   }
+   if(old != NULL) freeHashIndex(old);
+   return 1;
+}
+int  findValue(IteratorG it, void *key){
+   STAT_TIME(it, STAT_FINDVALUE);
+   if(it->hash == NULL){
+      struct IteratorGRep walker = *it;
+      reset(&walker);
+      while(hasNext(&walker)){
+         struct IteratorGRep before = walker;
+         if(callCmp(it, next(&walker), key) == 0){
+            *it = before;
+            return 1;
+         }
+      }
+      return 0;
+   }
+   void** slot = hashFind(it, key);
+   if(slot == NULL) return 0;
+   //the element's position is known but not its index, distanceFromStart() works that out if asked
+   it->curs = it->ops->locate(it, slot);
+   if(it->fwd == PREV) it->ops->step(it, &it->curs, NEXT);
+   it->index = -1;
+   return 1;
+}
+int  countValue(IteratorG it, void *key){
+   if(it->hash != NULL) return hashCount(it, key);
+   struct IteratorGRep walker = *it;
+   int count = 0;
+   reset(&walker);
+   while(hasNext(&walker)){
+      if(callCmp(it, next(&walker), key) == 0) count++;
+   }
+   return count;
+}
+int  addMany(IteratorG it, void const *array, size_t n, size_t stride){
+   if(n == 0) return 1;
+   if(it->view && !materialize(it)) return 0;
+   if(readOnly(it)) return 0;
+   //an indexed list needs to see every new element, so it only gets the bulk insert without one
+   if(it->ops->insertMany != NULL && it->hash == NULL){
+      if(!it->ops->insertMany(it, &it->curs, it->fwd, array, n, stride)){
+         fprintf(stderr, "Error -- unable to add new nodes");
+         return 0;
+      }
+      it->size += n;
+      return 1;
+   }
+   //otherwise the elements go in one at a time
+   size_t i;
+   for(i = 0; i < n; i++){
+      if(!add(it, (char*) array + stride * i)) return 0;
+   }
+   return 1;
+}
+
 int  hasNext(IteratorG it){
-   //if it->curs is pointing to mtend
-   if(it->curs->next == NULL) return 0;
-   else return 1;
+   if(it->filtered) return filterLook(it, 1);
+   if(it->index < 0) return it->ops->slot(it, it->curs, it->fwd) != NULL;
+   return it->index < it->size;
 }
 int  hasPrevious(IteratorG it){
-   if(it->curs->prev == it->mtstart) return 0;
-   else return 1;
+   if(it->filtered) return filterLook(it, 0);
+   if(it->index < 0) return it->ops->slot(it, it->curs, !it->fwd) != NULL;
+   return it->index > 0;
 }
 void *next(IteratorG it){
+   STAT_TIME(it, STAT_NEXT);
+   if(it->filtered) return filterMove(it, 1);
    if(hasNext(it)){
-      it->curs = it->curs->next;
-      return it->curs->prev->data;
+      if(it->index >= 0) it->index++;
+      return it->ops->step(it, &it->curs, it->fwd);
    }
    return NULL;
 }
 void *previous(IteratorG it){
+   STAT_TIME(it, STAT_PREVIOUS);
+   if(it->filtered) return filterMove(it, 0);
    if(hasPrevious(it)){
-      it->curs = it->curs->prev;
-      return it->curs->data;
+      if(it->index >= 0) it->index--;
+      return it->ops->step(it, &it->curs, !it->fwd);
    }
    return NULL;
 }
+//free an element taken out of the list, once no reader can see it if the list is concurrent
+static void reclaimElm(IteratorG it, void* data){
+   callFree(it, data);
+}
+static void dropElm(IteratorG it, void* data){
+   if(it->rcu != NULL){
+      rcuRetire(it, data, reclaimElm);
+   }else{
+      callFree(it, data);
+   }
+}
 int  del(IteratorG it){
+   STAT_TIME(it, STAT_DEL);
    if(hasPrevious(it)){
-      //unplug node
-      Node* tmp = it->curs->prev;
-      tmp->prev->next = it->curs;
-      it->curs->prev = tmp->prev;
-      
-      //free node
-      it->freeElm(tmp);
+      if(it->view && !materialize(it)) return 0;
+      if(readOnly(it)) return 0;
+      //a concurrent list retires the node and the element, the records for that are made before anything changes
+      if(it->rcu != NULL && !rcuReserve(it->rcu, 2)) return 0;
+      //unplug the element and free it
+      void** slot = it->ops->slot(it, it->curs, !it->fwd);
+      if(it->hash != NULL) hashRemove(it, slot);
+      int heap = ownsHeap(it, slot);
+      void* data = it->ops->remove(it, &it->curs, !it->fwd);
+      if(heap) dropElm(it, data);
+      it->size--;
+      if(it->index >= 0) it->index--;
       return 1;
    }
    //else no previous element to delete
    return 0;
 }
+void *take(IteratorG it){
+   if(hasPrevious(it)){
+      if(it->view && !materialize(it)) return NULL;
+      //cursors of a concurrent list may still be reading the element, so it can't be handed on
+      if(readOnly(it) || it->rcu != NULL) return NULL;
+      if(it->elemSize > 0 && it->newElm == NULL) return NULL;
+      void** slot = it->ops->slot(it, it->curs, !it->fwd);
+      void* data = *slot;
+      //a short string lives in its node, which is about to go, so it is the one thing copied
+      if(!ownsHeap(it, slot)){
+         data = callNew(it, data);
+         if(data == NULL) return NULL;
+      }
+      if(it->hash != NULL) hashRemove(it, slot);
+      it->ops->remove(it, &it->curs, !it->fwd);
+      it->size--;
+      if(it->index >= 0) it->index--;
+      return data;
+   }
+   return NULL;
+}
+//whether vp could replace the element behind the cursor without breaking a sorted list's order
+static int fitsOrder(IteratorG it, void *vp){
+   Pos p = it->curs;
+   it->ops->step(it, &p, !it->fwd);
+   void** ahead = it->ops->slot(it, it->curs, it->fwd);
+   void** behind = it->ops->slot(it, p, !it->fwd);
+   void** lo = (it->fwd == NEXT) ? behind : ahead;
+   void** hi = (it->fwd == NEXT) ? ahead : behind;
+   return (lo == NULL || callCmp(it, *lo, vp) <= 0) && (hi == NULL || callCmp(it, vp, *hi) <= 0);
+}
 int  set(IteratorG it, void *vp){
+   STAT_TIME(it, STAT_SET);
    if(hasPrevious(it)){
-      it->curs->prev->data = vp;
+      if(it->view && !materialize(it)) return 0;
+      if(readOnly(it)) return 0;
+      if(it->sorted && !fitsOrder(it, vp)) return 0;
+      if(it->rcu != NULL && !rcuReserve(it->rcu, 1)) return 0;
+      void** slot = it->ops->slot(it, it->curs, !it->fwd);
+      if(it->hash != NULL) hashRemove(it, slot);
+      //the list owns its elements, so store a copy of vp and free the one being replaced
+      void* old = *slot;
+      int heap = ownsHeap(it, slot);
+      if(it->elemSize > 0){
+         listCopyElm(it, (Node*) slot, vp);
+      }else{
+         __atomic_store_n(slot, callNew(it, vp), __ATOMIC_RELEASE);
+      }
+      if(heap) dropElm(it, old);
+      //hashRemove kept its entry for this, so it can't run out of memory
+      if(it->hash != NULL) hashAdd(it, slot);
       return 1;
    }
    return 0;
 }
 IteratorG advance(IteratorG it, int n){
-   IteratorG advancenew = newIterator(it->cmpElm, it->newElm, it->freeElm);
+   STAT_TIME(it, STAT_ADVANCE);
    int count;
-   //first determine the sign of n
-   if(n > 0){
-      //if we can't move forward n places, return NULL
-      if(distanceToEnd(it) < n) return NULL;
-      
-      for(count = 1; count <= n; count++){
-         add(advancenew, it->curs->data); //add nodes until count = n
-         it->curs = it->curs->next;
+   //if we can't move n places, return NULL
+   //a filter only finds out how many matches it has left by moving
+   if(!it->filtered){
+      if(n > 0 && distanceToEnd(it) < n) return NULL;
+      if(n < 0 && distanceFromStart(it) < abs(n)) return NULL;
+   }
+   struct IteratorGRep from = *it;
+   if(!it->filtered && it->ops->seek != NULL){
+      //jump straight to the new position
+      int r = it->ops->rank(it, it->curs);
+      it->curs = it->ops->seek(it, (it->fwd == NEXT) ? r + n : r - n);
+      it->index += n;
+   }else{
+      for(count = 1; count <= abs(n); count++){
+         if(((n > 0) ? next(it) : previous(it)) == NULL){
+            *it = from;
+            return NULL;
+         }
       }
-      reverse(advancenew); //reverse the order since add() places the a new node prev to the cursor
-      reset(advancenew); //move the cursor to the start of the reversed list
-      return advancenew; 
-   }else if(n < 0){
-      //if we can't move backwards n places, return NULL
-      if(distanceFromStart(it) < abs(n)) return NULL;
+   }
+   
+   //the result is a view of the elements the cursor passed over, nothing is copied
+   IteratorG advancenew = malloc(sizeof(struct IteratorGRep));
+   assert (advancenew != NULL);
+   *advancenew = from;
+   advancenew->view = 1;
+   advancenew->sorted = 0;
+   advancenew->hash = NULL;
+   advancenew->rcu = NULL;
+   advancenew->staging = NULL;
+   advancenew->size = abs(n);
+   advancenew->index = 0;
+   
+   //the view reads its elements in the order the cursor passed them
+   int d = (n >= 0) ? from.fwd : !from.fwd;
+   advancenew->fwd = d;
+   advancenew->vends[!d] = from.curs;
+   advancenew->vends[d] = it->curs;
+   if(from.filtered){
+      //the elements passed over are not next to each other, so the view filters them too
+      advancenew->filt.preds = copyPreds(&from, 0);
+      advancenew->filt.raw = 0;
+      advancenew->filt.rawSize = abs(it->filt.raw - from.filt.raw);
+      advancenew->filt.lookDir = -1;
+   }
+   return advancenew; 
+}
+//the nodes stay where they are, the iterator just starts reading its links the other way round
+//flipping the direction leaves the cursor at the mirrored index, but reverse() has always kept
+//a cursor in the middle of the list at the same distance from the start, so it is moved back there
+//(at either end the mirrored index is the other end, which is where it goes, so that costs nothing)
+void reverse(IteratorG it){
+   it->fwd = !it->fwd;
+   if(it->filtered){
+      it->filt.raw = it->filt.rawSize - it->filt.raw;
+      it->filt.lookDir = -1;
+      it->index = (it->size >= 0 && it->index >= 0) ? it->size - it->index : -1;
+   }else if(it->index >= 0){
+      it->index = it->size - it->index;
+   }
+   int index = distanceFromStart(it);
+   int n = size(it);
+   if(index > 0 && index < n) seek(it, n - index);
+}
+//the eager version of filter(), the matches are copied into a list of their own
+IteratorG find(IteratorG it, int (*fp) (void *vp) ){
+   STAT_TIME(it, STAT_FIND);
+   IteratorG findsnew = filter(it, fp);
+   if(!materialize(findsnew)){
+      freeIt(findsnew);
+      return NULL;
+   }
+   return findsnew;
+}
 
-      for(count = 1; count <= abs(n); count++){
-         add(advancenew, it->curs->prev->data); //add nodes until count = abs(n)
-         it->curs = it->curs->prev;
+//findParallel's threads take PARALLEL_CHUNK elements at a time, so a slow stretch of the list doesn't hold up the rest
+#define PARALLEL_CHUNK 4096
+
+typedef struct FindJob {
+   int (*fp)(void *vp);
+   void** elems;
+   char* pass;   //pass[i] is set to whether elems[i] matched
+   int n;
+   int taken;    //elements handed out so far, shared by the threads
+} FindJob;
+
+static void* findWorker(void* arg){
+   FindJob* job = arg;
+   int lo;
+   while((lo = __atomic_fetch_add(&job->taken, PARALLEL_CHUNK, __ATOMIC_RELAXED)) < job->n){
+      int hi = (lo + PARALLEL_CHUNK < job->n) ? lo + PARALLEL_CHUNK : job->n;
+      int i;
+      for(i = lo; i < hi; i++){
+         job->pass[i] = job->fp(job->elems[i]) != 0;
       }
-      reverse(advancenew); 
-      reset(advancenew); 
-      return advancenew;
-   }else{ //n == 0
-      return advancenew; //return an empty list
    }
    return NULL;
 }
-void reverse(IteratorG it){
-   //reverse begins with pointers pointing at the first and last nodes
-   //each iteration the nodes are swapped and there pointers gradually come to the centre of the list
-   
-   Node* LHS = it->mtstart->next; //point LHS to the first node in the list
-   //keep pointers for the nodes either side of LHS
-   Node* LHSnext;// = LHS->next 
-   Node* LHSprev;// = LHS->prev;
-   
-   Node* RHS = it->mtend->prev; //point RHS to the last node in the list
-   //keep pointers for the node either side of RHS
-   Node* RHSnext;// = RHS->next; 
-   Node* RHSprev;// = RHS->prev;
-   
-   Node* tmp; //used for swapping it->curs
-   int edge_curs_set = 0; //used to indicate whether a cursor at either ends has already been moved
-   
-   //if the cursor points infront of the first node we set it to the correct position at the end of the list
-   if(it->curs == it->mtstart->next){
-      it->curs = it->mtend;
-      edge_curs_set = 1;
-   }
-
-   //the loop will iterate until both LHS and RHS point to the same node
-   //if LHS and RHS are adjacent they are swapped and the loop breaks
-   while(LHS != RHS){
-      //reset pointers relative to where LHS and RHS are in this iteration
-      LHSnext = LHS->next; 
-      LHSprev = LHS->prev;
-      RHSnext = RHS->next;
-      RHSprev = RHS->prev;
-      
-      //SWAPPING THE POSITIONS OF LHS AND RHS:
-      //1). if LHS and RHS are adjacent, you can skip some steps
-      if(LHS->next == RHS && RHS->prev == LHS){
-        //{LHSprev}--><--{LHS}--><--{RHS}--><--{RHSnext}
-        LHS->next = RHSnext;
-        RHSnext->prev = LHS;
-        RHS->prev = LHSprev;
-        LHSprev->next = RHS;
-        LHS->prev = RHS;
-        RHS->next = LHS;
-        //{LHSprev}--><--{RHS}--><--{LHS}--><--{RHSnext}
-        //now swap which nodes LHS and RHS point to
-         tmp = LHS;
-         LHS = RHS;
-         RHS = tmp;
-         break;
-      //2). if LHS and RHS are adjacent, more steps are required
-      }else{
-        LHS->prev = RHSprev;  //--{RHSprev}<--{LHS}--><--{LHSnext}--
-        RHSprev->next = LHS;  //--{RHSprev}--><--{LHS}--><--{LHSnext}--
-
-        LHS->next = RHSnext;  //--{RHSprev}--><--{LHS}-->{RHSnext}--
-        //printf("THis is where things go wrong\n");
-        RHSnext->prev = LHS;  //--{RHSprev}--><--{LHS}--><--{RHSnext}--
-
-        RHS->prev = LHSprev;  //--{LHSprev}<--{RHS}--><--{RHSnext}--
-        LHSprev->next = RHS;  //--{LHSprev}--><--{RHS}--><--{RHSnext}--
-
-        RHS->next = LHSnext;  //--{LHSprev}--><--{RHS}-->{LHSnext}--
-        LHSnext->prev = RHS;  //--{LHSprev}--><--{RHS}--><--{LHSnext}--
-        
-        //now swap which nodes LHS and RHS point to
-        tmp = LHS;
-        LHS = RHS;
-        RHS = tmp;
+
+int  gatherAhead(IteratorG it, void** out, int max){
+   int n = 0;
+   if(it->filtered){
+      while(n < max && hasNext(it)){
+         out[n++] = next(it);
       }
-            
-      if(LHS == it->curs){ 
-         it->curs = RHS;
-      }else if(RHS == it->curs){
-         it->curs = LHS;
+      return n;
+   }
+   n = distanceToEnd(it);
+   if(n > max) n = max;
+   if(it->ops->gather != NULL){
+      it->ops->gather(it, &it->curs, it->fwd, out, n);
+   }else{
+      int i;
+      for(i = 0; i < n; i++){
+         out[i] = it->ops->step(it, &it->curs, it->fwd);
       }
-      //move LHS forward and move RHS backwards 
-      LHS = LHS->next;
-      RHS = RHS->prev;
    }
-   
-   //conditions necessary when the cursor is at the end of the list and hasn't already been moved
-   if(it->curs == it->mtend && edge_curs_set == 0){
-      it->curs = it->mtstart->next;
+   it->index += n;
+   return n;
+}
+
+int  appendMatches(IteratorG it, void** elems, char const *pass, int n){
+   int i;
+   for(i = 0; i < n; i++){
+      if(!pass[i]) continue;
+      //inserting on the PREV side of the end leaves the cursor after the new element
+      if(!it->ops->insert(it, &it->curs, PREV, elems[i])) return 0;
+      it->size++;
+      it->index++;
    }
-	return;
+   return 1;
 }
-IteratorG find(IteratorG it, int (*fp) (void *vp) ){
-   IteratorG findsnew = newIterator(it->cmpElm, it->newElm, it->freeElm);
-   //if the cursor is at the end of the list, return the empty list
-   if(!hasNext(it)) return findsnew;
-   Node* tmp = it->curs;
-   while(1){
-      if(fp(it->curs->data)){ //if fp returns 1 add a new node with curs->data
-         add(findsnew, it->curs->data);
-      }
-      //if curs is at the last data entry node break
-      if(it->curs->next == it->mtend) break;
-      it->curs = it->curs->next;
+
+//addMany() on a walker takes the elements it is given rather than copying them
+static void* adoptElm(void const *vp){
+   return * (void* const *) vp;
+}
+
+int  addAdopted(IteratorG it, void** elems, int n){
+   if(it->view && !materialize(it)) return 0;
+   //other threads may be reading newElm (stage()), so it is swapped on a copy of the iterator rather than it
+   struct IteratorGRep walker = *it;
+   walker.newElm = adoptElm;
+   int before = it->size;
+   addMany(&walker, elems, n, sizeof(void*));
+   it->curs = walker.curs;
+   it->size = walker.size;
+   it->index = walker.index;
+   return it->size - before;
+}
+
+IteratorG findParallel(IteratorG it, int (*fp) (void *vp), int nthreads){
+   //collect the elements ahead of the cursor so the threads can split them up by index
+   int n = distanceToEnd(it);
+   FindJob job = { fp, malloc(n * sizeof(void*) + 1), malloc(n + 1), n, 0 };
+   if(job.elems == NULL || job.pass == NULL){
+      free(job.elems);
+      free(job.pass);
+      return NULL;
    }
-   it->curs = tmp;
-   reverse(findsnew);
-   reset(findsnew);
+   struct IteratorGRep walker = *it;
+   int i;
+   gatherAhead(&walker, job.elems, n);
+
+   //the calling thread works too, so only nthreads - 1 are started
+   if(nthreads > (n + PARALLEL_CHUNK - 1) / PARALLEL_CHUNK) nthreads = (n + PARALLEL_CHUNK - 1) / PARALLEL_CHUNK;
+   pthread_t* threads = (nthreads > 1) ? malloc((nthreads - 1) * sizeof(pthread_t)) : NULL;
+   int started = 0;
+   while(threads != NULL && started < nthreads - 1 && pthread_create(&threads[started], NULL, findWorker, &job) == 0){
+      started++;
+   }
+   findWorker(&job);
+   for(i = 0; i < started; i++){
+      pthread_join(threads[i], NULL);
+   }
+   free(threads);
+   STAT(it, predCalls, n);
+
+   //the matches are copied in their original order, just as find() would
+   IteratorG findsnew = newIteratorLike(it);
+   if(findsnew != NULL && !appendMatches(findsnew, job.elems, job.pass, n)){
+      freeIt(findsnew);
+      findsnew = NULL;
+   }
+   if(findsnew != NULL) reset(findsnew);
+   free(job.elems);
+   free(job.pass);
    return findsnew;
 }
 
 int distanceFromStart(IteratorG it){
-   int dist = 0;
-   Node* tmp = it->curs;
-   while(tmp->prev != it->mtstart){
-      dist++;
-      tmp = tmp->prev;
+   if(it->index < 0 && it->filtered){
+      it->index = filterCount(it, 0);
+   }else if(it->index < 0 && it->ops->rank != NULL){
+      it->index = indexOf(it, it->curs);
+   }else if(it->index < 0){
+      //count the elements behind the cursor
+      Pos p = it->curs;
+      for(it->index = 0; it->ops->slot(it, p, !it->fwd) != NULL; it->index++){
+         it->ops->step(it, &p, !it->fwd);
+      }
    }
-   return dist;
+   return it->index;
 
 }
 int distanceToEnd(IteratorG it){
-   int dist = 0;
-   Node* tmp = it->curs;
-   while(it->curs->next != NULL){
-      dist++;
-      it->curs = it->curs->next;
+   if(it->filtered) return filterCount(it, 1);
+   return it->size - distanceFromStart(it);
+}
+int seek(IteratorG it, int index){
+   STAT_TIME(it, STAT_SEEK);
+   if(index < 0 || index > size(it)) return 0;
+   if(!it->filtered && it->ops->seek != NULL){
+      int base = it->ops->rank(it, endOf(it, !it->fwd));
+      it->curs = it->ops->seek(it, (it->fwd == NEXT) ? base + index : base - index);
+      it->index = index;
+      return 1;
    }
-   it->curs = tmp;
-   return dist;
+   //otherwise walk there, from the start if that is closer
+   if(index < distanceFromStart(it) - index) reset(it);
+   while(it->index < index) next(it);
+   while(it->index > index) previous(it);
+   return 1;
+}
+int size(IteratorG it){
+   if(it->size < 0) it->size = distanceFromStart(it) + distanceToEnd(it);
+   return it->size;
 }
 void reset(IteratorG it){
-   while(hasPrevious(it)){
-      it->curs = it->curs->prev;
+   it->curs = endOf(it, !it->fwd);
+   it->index = 0;
+   if(it->filtered){
+      it->filt.raw = 0;
+      it->filt.lookDir = -1;
    }
    return;
 }
 void freeIt(IteratorG it){
-   reset(it);
-   while(1){
-      it->freeElm(it->curs->prev);
-      if(!hasNext(it)) break;
-      it->curs = it->curs->next;
-   }
+   //a view only borrows its store
+   if(it->staging != NULL) freeStaging(it, it->staging);
+   if(it->rcu != NULL) freeRcu(it, it->rcu);
+   if(!it->view) it->ops->destroy(it);
+   if(it->hash != NULL) freeHashIndex(it->hash);
+   if(it->filtered) free(it->filt.preds);
+#ifdef ITERATORG_STATS
+   if(!it->view) free(it->stats);
+#endif
+   free(it);
 	return;
 }
 
+int  getIteratorStats(IteratorG it, IteratorStats *stats){
+#ifdef ITERATORG_STATS
+   *stats = *it->stats;
+   return 1;
+#else
+   memset(stats, 0, sizeof(IteratorStats));
+   return 0;
+#endif
+}
+
+/* =====   Cursor functions  ===== */
 
+int  makeConcurrent(IteratorG it){
+   //readers follow list nodes, and elements are swapped whole by set() rather than copied over in place
+   if(it->view || it->ops != &listOps || it->elemSize > 0) return 0;
+   if(it->rcu != NULL) return 1;
+   it->rcu = newRcu(it->fwd);
+   return it->rcu != NULL;
+}
 
+//readers of a concurrent list only load what the writer stores with release, see listInsert()
+static Node* loadLink(Node* n, int d){
+   return __atomic_load_n(&n->link[d], __ATOMIC_ACQUIRE);
+}
 
+static void concurrentReset(CursorG c){
+   ListStore* ls = c->it->store;
+   rcuPin(c->it->rcu, c->reader);
+   //nodes the cursor had are let go of here, so it starts again from a sentinel
+   c->curs.node = (c->fwd == NEXT) ? loadLink(ls->mtstart, NEXT) : ls->mtend;
+   c->index = 0;
+}
 
+//the node on reading side dir (1 ahead, 0 behind) of a concurrent cursor, NULL if there is none
+static Node* concurrentSide(CursorG c, int dir){
+   ListStore* ls = c->it->store;
+   int d = dir ? c->fwd : !c->fwd;
+   Node* n = (d == NEXT) ? c->curs.node : loadLink(c->curs.node, PREV);
+   return (n == ls->mtend || n == ls->mtstart) ? NULL : n;
+}
 
+static void* concurrentMove(CursorG c, int dir){
+   Node* n = concurrentSide(c, dir);
+   if(n == NULL) return NULL;
+   //the cursor stays infront of a node, so moving over n physically forwards leaves it infront of n's next
+   int d = dir ? c->fwd : !c->fwd;
+   c->curs.node = (d == NEXT) ? loadLink(n, NEXT) : n;
+   c->index += dir ? 1 : -1;
+   return __atomic_load_n(&n->data, __ATOMIC_ACQUIRE);
+}
+
+//how many elements a concurrent cursor can move over in reading direction dir right now
+static int concurrentCount(CursorG c, int dir){
+   struct CursorGRep walker = *c;
+   int count = 0;
+   while(concurrentMove(&walker, dir) != NULL){
+      count++;
+   }
+   return count;
+}
+
+CursorG newCursor(IteratorG it){
+   CursorG c = malloc(sizeof(struct CursorGRep));
+   assert (c != NULL);
+   c->it = it;
+   c->reader = NULL;
+   if(it->rcu != NULL){
+      //it's cursor belongs to the writer, so these start from the beginning instead
+      c->reader = rcuJoin(it->rcu);
+      assert (c->reader != NULL);
+      c->fwd = rcuReaderFwd(it->rcu);
+      c->raw = 0;
+      concurrentReset(c);
+      return c;
+   }
+   c->curs = it->curs;
+   c->index = it->index;
+   c->raw = it->filtered ? it->filt.raw : 0;
+   c->fwd = it->fwd;
+   return c;
+}
+
+void freeCursor(CursorG c){
+   if(c->reader != NULL) rcuLeave(c->it->rcu, c->reader);
+   free(c);
+}
+
+//a copy of c's iterator with c's position, for the iterator functions to move
+static struct IteratorGRep throughCursor(CursorG c){
+   struct IteratorGRep walker = *c->it;
+   walker.curs = c->curs;
+   walker.index = c->index;
+   walker.fwd = c->fwd;
+   if(walker.filtered){
+      walker.filt.raw = c->raw;
+      walker.filt.lookDir = -1;
+   }
+   return walker;
+}
+
+static void moveCursor(CursorG c, IteratorG walker){
+   c->curs = walker->curs;
+   c->index = walker->index;
+   if(walker->filtered) c->raw = walker->filt.raw;
+}
+
+int  cursorHasNext(CursorG c){
+   if(c->reader != NULL) return concurrentSide(c, 1) != NULL;
+   struct IteratorGRep walker = throughCursor(c);
+   return hasNext(&walker);
+}
+int  cursorHasPrevious(CursorG c){
+   if(c->reader != NULL) return concurrentSide(c, 0) != NULL;
+   struct IteratorGRep walker = throughCursor(c);
+   return hasPrevious(&walker);
+}
+void *cursorNext(CursorG c){
+   if(c->reader != NULL) return concurrentMove(c, 1);
+   struct IteratorGRep walker = throughCursor(c);
+   void* data = next(&walker);
+   moveCursor(c, &walker);
+   return data;
+}
+void *cursorPrevious(CursorG c){
+   if(c->reader != NULL) return concurrentMove(c, 0);
+   struct IteratorGRep walker = throughCursor(c);
+   void* data = previous(&walker);
+   moveCursor(c, &walker);
+   return data;
+}
+int  cursorDistanceFromStart(CursorG c){
+   if(c->reader != NULL) return c->index = concurrentCount(c, 0);
+   struct IteratorGRep walker = throughCursor(c);
+   c->index = distanceFromStart(&walker);
+   return c->index;
+}
+int  cursorDistanceToEnd(CursorG c){
+   if(c->reader != NULL) return concurrentCount(c, 1);
+   struct IteratorGRep walker = throughCursor(c);
+   return distanceToEnd(&walker);
+}
+int  cursorSeek(CursorG c, int index){
+   if(c->reader != NULL){
+      //the list may change under the cursor, so the only way there is to walk from the start
+      if(index < 0) return 0;
+      concurrentReset(c);
+      while(c->index < index){
+         if(concurrentMove(c, 1) == NULL) return 0;
+      }
+      return 1;
+   }
+   struct IteratorGRep walker = throughCursor(c);
+   int ok = seek(&walker, index);
+   moveCursor(c, &walker);
+   return ok;
+}
+void cursorReset(CursorG c){
+   if(c->reader != NULL){
+      concurrentReset(c);
+      return;
+   }
+   struct IteratorGRep walker = throughCursor(c);
+   reset(&walker);
+   moveCursor(c, &walker);
+}
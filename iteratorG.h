@@ -6,26 +6,168 @@
 #include <stdio.h>
 
 typedef struct IteratorGRep *IteratorG;
+typedef struct CursorGRep *CursorG;
 
 typedef int   (*ElmCompareFp)(void const *e1, void const *e2);
 typedef void *(*ElmNewFp)(void const *e1);
 typedef void  (*ElmFreeFp)(void *e1);
+typedef unsigned (*ElmHashFp)(void const *e1);  //equal elements (by cmpElm) must hash the same
+typedef size_t (*ElmSizeFp)(void const *e1);     //number of bytes making up an element that has no pointers in it
+
+//the data structures an iterator can be built on
+//LIST_BACKEND is one node per element, UNROLLED_BACKEND packs up to 32 elements per node
+//TREE_BACKEND keeps the elements in a balanced tree, so seek() and advance() are O(log n)
+typedef enum { LIST_BACKEND, UNROLLED_BACKEND, TREE_BACKEND } IteratorBackend;
+
+//what getIteratorStats() reports, the counters are only kept when built with -DITERATORG_STATS
+//latency[op][b] counts calls that took from 2^b up to 2^(b+1) nanoseconds, calls made by other iterator functions aren't timed
+typedef enum { STAT_ADD, STAT_NEXT, STAT_PREVIOUS, STAT_DEL, STAT_SET, STAT_ADVANCE, STAT_FIND, STAT_FINDVALUE, STAT_SEEK, STAT_NOPS } IteratorStatOp;
+#define STAT_BUCKETS 32
+typedef struct IteratorStats {
+   unsigned long nodesAllocated;  //nodes (list nodes, unrolled chunks, tree nodes) made and freed
+   unsigned long nodesFreed;
+   long bytesInUse;               //bytes of the nodes currently in the list, not counting what newElm made
+   unsigned long nodeMallocs;     //mallocs made for those nodes, LIST_BACKEND makes one per slab of nodes
+   unsigned long hops;            //elements stepped over inside the backend
+   unsigned long cmpCalls;
+   unsigned long newCalls;
+   unsigned long freeCalls;
+   unsigned long predCalls;       //calls of find(), filter() and findParallel() predicates
+   unsigned long calls[STAT_NOPS];
+   unsigned long latency[STAT_NOPS][STAT_BUCKETS];
+} IteratorStats;
 
 //iterator operation functions:
 IteratorG newIterator(ElmCompareFp cmpFp, ElmNewFp newFp, ElmFreeFp freeFp);
+//elements of elemSize bytes are copied straight into the list nodes, so there is no newElm/freeElm
+//next() and previous() return pointers into the node, valid until that element is deleted
+IteratorG newIteratorInline(size_t elemSize, ElmCompareFp cmpFp);
+//a list of strings, where strings of up to 23 characters are copied into the list nodes
+//and only longer ones are made with newFp (e.g. stringNew) and freed with freeFp
+IteratorG newIteratorStrings(ElmCompareFp cmpFp, ElmNewFp newFp, ElmFreeFp freeFp);
+//a sorted iterator keeps its elements in cmpElm order (descending once reversed)
+//add() on it is insertSorted(), and set() fails if the new value would be out of order
+IteratorG newIteratorSorted(ElmCompareFp cmpFp, ElmNewFp newFp, ElmFreeFp freeFp);
+//newIterator uses the default backend (LIST_BACKEND unless changed with setDefaultBackend)
+IteratorG newIteratorBackend(IteratorBackend backend, ElmCompareFp cmpFp, ElmNewFp newFp, ElmFreeFp freeFp);
+void setDefaultBackend(IteratorBackend backend);
+//the same as newIterator followed by addMany, so the list holds the array back to front
+IteratorG newIteratorFromArray(void const *array, size_t n, size_t stride, ElmCompareFp cmpFp, ElmNewFp newFp, ElmFreeFp freeFp);
 int  add(IteratorG it, void *vp);
+//the same as calling add on each of the n elements stride bytes apart in array, in order,
+//but the list backend allocates all the nodes in one block
+int  addMany(IteratorG it, void const *array, size_t n, size_t stride);
+//read whitespace separated ints, or one string per line, from fd until the end of the input
+//the same as calling add on each in turn, returns how many were added or -1 on a read error or bad int
+//(the elements before the error stay in the list)
+//nothing reads fd once they return, but after an error its position is undefined, input past the error may be read
+int  ingestInts(IteratorG it, int fd);
+int  ingestStrings(IteratorG it, int fd);
+//a queue any thread can stage() elements on without locking, for the iterator's own thread to drainInto() it
+//attachStaging has to be called before other threads stage, 0 for views, read only iterators or if out of memory
+//stage copies vp straight away (so newElm must be thread safe), 0 if out of memory or there is no queue
+int  attachStaging(IteratorG it);
+int  stage(IteratorG it, void *vp);
+//the same as calling add on everything staged so far, in the order it was staged, but a list gets it in one splice
+//returns how many were added or -1 if out of memory (any that didn't fit are dropped)
+int  drainInto(IteratorG it);
+//these only work on sorted iterators and take O(log n)
+//insertSorted puts vp after any equal elements and leaves the cursor just before it, 0 if it is not sorted
+int  insertSorted(IteratorG it, void *vp);
+//the index of the first element not before key in reading order, -1 if it is not sorted
+int  lowerBound(IteratorG it, void *key);
+//moves the cursor to lowerBound(it, key), returns 1 if next() would then return an element equal to key
+int  seekTo(IteratorG it, void *key);
+int  contains(IteratorG it, void *key);
+//keeps a hash table of the elements, updated by add/del/set, for findValue and countValue
+//needs the LIST_BACKEND or TREE_BACKEND, returns 0 for other backends, views or if out of memory
+int  attachHashIndex(IteratorG it, ElmHashFp hashFp);
+//moves the cursor so next() returns the first element equal to key in reading order, 0 if there is none
+//without a hash index it scans from the start, with one it takes O(1) expected time if only one element equals key,
+//otherwise a list walks from its start to the first of them and the tree backend compares their ranks
+int  findValue(IteratorG it, void *key);
+int  countValue(IteratorG it, void *key);
 int  hasNext(IteratorG it);
 int  hasPrevious(IteratorG it);
 void *next(IteratorG it);
 void *previous(IteratorG it);
 int  del(IteratorG it);
+//set replaces the element previous() would return with a copy of vp made like add() makes one, and frees the old one,
+//so the list owns every element it holds and vp stays the caller's (it used to store vp itself)
 int  set(IteratorG it, void *vp);
+//move versions of add and del, the element changes hands rather than being copied with newElm or freed with freeElm
+//addOwned adds vp itself, which must have come from newElm (or be fit for freeElm), and the list frees it from then on
+//take unlinks the element previous() would return and gives it to the caller to free, NULL if there is none
+//if addOwned returns 0 vp is still the caller's, neither works on iterators of newIteratorInline (0 or NULL),
+//nor take on concurrent or read only ones
+int  addOwned(IteratorG it, void *vp);
+void *take(IteratorG it);
+//advance returns a view of the elements passed over that borrows them from it
+//the view is only valid until it is modified or freed, add/del/set on the view copy it first
 IteratorG advance(IteratorG it, int n);
+//turns a view into an independent list holding copies of its elements, 0 if out of memory
+int materialize(IteratorG it);
+//reverse is O(1) with the cursor at either end, which it moves to the other end
+//a cursor in between stays the same distance from the start, costing a seek() to get there
 void reverse(IteratorG it);
 IteratorG find(IteratorG it, int (*fp) (void *vp) );
+//a lazy find(): next()/previous() walk the elements from it's cursor to the end, skipping those fp rejects
+//fp is only called when the filter moves or looks ahead, filters can be filtered and advanced like views
+IteratorG filter(IteratorG it, int (*fp) (void *vp) );
+//gives the same list as find(), but fp is called from up to nthreads threads at once, so it must be thread safe
+IteratorG findParallel(IteratorG it, int (*fp) (void *vp), int nthreads);
+//puts the elements in cmpElm order, in reading order from the start, keeping equal elements in the order they were
+//the elements themselves stay where they are in memory, so pointers from next() stay valid, the cursor is reset
+//0 if out of memory, for read only and concurrent iterators, and for a sorted iterator that has been reversed
+int  sortIt(IteratorG it);
+//the same as sortIt, but parts of the list are sorted and merged on up to nthreads threads at once,
+//so cmpElm must be thread safe
+int  sortItParallel(IteratorG it, int nthreads);
+//built in versions of find() and friends for iterators of ints, they test blocks of elements with SIMD instructions
+//like find() they look at the elements from the cursor to the end, ranges include both lo and hi
+IteratorG findGreaterEq(IteratorG it, int min);
+IteratorG findRange(IteratorG it, int lo, int hi);
+int countRange(IteratorG it, int lo, int hi);
+long long sumInts(IteratorG it);
 int distanceFromStart(IteratorG it);
 int distanceToEnd(IteratorG it);
+int size(IteratorG it);
+//moves the cursor so that index elements are before it, 0 if index is out of range
+int seek(IteratorG it, int index);
 void reset(IteratorG it);
+//writes every element, in reading order, to a file at path, sizeFp gives how many bytes of each to save, 0 on failure
+int  saveIterator(IteratorG it, char const *path, ElmSizeFp sizeFp);
+//maps a file made by saveIterator, next() and previous() return pointers straight into it
+//the iterator is read only (add/del/set return 0), views of it and find() results are copied with newFp and freed with freeFp
+IteratorG loadIterator(char const *path, ElmCompareFp cmpFp, ElmNewFp newFp, ElmFreeFp freeFp);
 void freeIt(IteratorG it);
+//copies it's counters into stats, views count towards the iterator they were made from
+//returns 0, with stats all zero, unless built with -DITERATORG_STATS
+int  getIteratorStats(IteratorG it, IteratorStats *stats);
+
+//cursor functions:
+//an IteratorG is a list with one cursor built in, a CursorG is one more cursor over the same list
+//cursors start where it's cursor is and read in the direction it does when they are made
+//any number of them can read a list at once, from different threads too, as long as nothing changes it
+//add/del/set through the iterator can leave a cursor pointing at a deleted element, so make new ones after
+//concurrent mode lets cursors read while one thread changes the list through the iterator,
+//for LIST_BACKEND iterators of pointer elements (newIterator), 0 for others or if out of memory
+//readers never lock or wait, but may or may not see changes made while they read,
+//elements del() or set() take out are only freed once every cursor that might see them has been reset or freed
+//(so del() and set() return 0, changing nothing, if there is no memory left to keep track of them)
+//cursors of a concurrent list start at its start, in the direction it had when makeConcurrent was called,
+//and newCursor/freeCursor can be called from any thread, everything else on the iterator is for the writer only
+//a cursor that is never reset holds on to everything deleted after it was made
+int  makeConcurrent(IteratorG it);
+CursorG newCursor(IteratorG it);
+void freeCursor(CursorG c);
+int  cursorHasNext(CursorG c);
+int  cursorHasPrevious(CursorG c);
+void *cursorNext(CursorG c);
+void *cursorPrevious(CursorG c);
+int  cursorDistanceFromStart(CursorG c);
+int  cursorDistanceToEnd(CursorG c);
+int  cursorSeek(CursorG c, int index);
+void cursorReset(CursorG c);
 
 #endif
@@ -0,0 +1,168 @@
+// iteratorGRep.h ... representation shared by iteratorG.c and the iterator backends
+// clients should only ever need iteratorG.h
+
+#ifndef ITERATORGREP_H
+#define ITERATORGREP_H
+
+#include "iteratorG.h"
+
+//directions used by the backend operations
+#define PREV 0
+#define NEXT 1
+
+//counters for getIteratorStats(), these compile to nothing without -DITERATORG_STATS
+//they are atomic since walkers and cursors on other threads share their iterator's stats
+#ifdef ITERATORG_STATS
+#define STAT(it, field, n) __atomic_fetch_add(&(it)->stats->field, (n), __ATOMIC_RELAXED)
+#else
+#define STAT(it, field, n) ((void) 0)
+#endif
+
+//a cursor position inside a backend, what node and off mean is up to the backend
+typedef struct Pos {
+   void* node;
+   int off;
+} Pos;
+
+//state of an iterator made by filter(), it walks the underlying range and skips elements failing a predicate
+typedef struct Filter {
+   int npreds;
+   int (**preds)(void *vp);  //an element has to pass all of these, owned by the filter
+   int raw;       //number of underlying elements before the cursor
+   int rawSize;   //number of underlying elements in the range
+   //the last look ahead (lookDir 1) or behind (lookDir 0), so next() does not test the same elements again
+   int lookDir;   //-1 when nothing is remembered
+   int found;     //whether that look found a match
+   int lookRaw;
+   Pos look;      //where the cursor goes when it moves over the match
+   void* lookData;
+} Filter;
+
+//every backend provides these, d is PREV or NEXT and always refers to the element on that side of p
+//directions are physical, the iterator functions map them through it->fwd
+typedef struct IteratorOps {
+   int    (*init)(IteratorG it);                             //set up an empty it->store, 0 if out of memory
+   void   (*destroy)(IteratorG it);                          //free every element and the store itself
+   Pos    (*end)(IteratorG it, int d);                       //position before the first (PREV) or after the last (NEXT) element
+   void** (*slot)(IteratorG it, Pos p, int d);               //where the element on side d of p keeps its data, NULL if there is none
+   void*  (*step)(IteratorG it, Pos* p, int d);              //move p over the element on side d and return that element
+   int    (*insert)(IteratorG it, Pos* p, int d, void *vp);  //copy vp into a new element on side d of p, 0 if out of memory
+   //the same as n inserts on side d of the elements stride bytes apart in array, may be NULL
+   int    (*insertMany)(IteratorG it, Pos* p, int d, void const *array, int n, size_t stride);
+   void*  (*remove)(IteratorG it, Pos* p, int d);            //unlink the element on side d of p and return its data
+   //backends that can find positions by index quickly provide these, both may be NULL
+   int    (*rank)(IteratorG it, Pos p);                      //number of elements before p
+   Pos    (*seek)(IteratorG it, int index);                  //the position with index elements before it
+   //backends that keep their elements ordered by cmpElm provide this, may be NULL
+   //the position before the first element not less than key (upper 0) or greater than key (upper 1)
+   Pos    (*bound)(IteratorG it, void const *key, int upper);
+   //backends whose slots never move provide this, may be NULL
+   Pos    (*locate)(IteratorG it, void** slot);             //the position with the element using slot on its NEXT side
+   //the same as n steps in direction d storing each element in out, the caller makes sure there are n, may be NULL
+   void   (*gather)(IteratorG it, Pos* p, int d, void** out, int n);
+   //backends that can put their elements in order without moving them between slots provide this, may be NULL
+   //stably sorts the elements into cmpElm order along direction d, with up to nthreads threads, 0 if out of memory
+   int    (*sort)(IteratorG it, int d, int nthreads);
+   //backends that keep elements inside evenly spaced nodes provide this, may be NULL (iteratorInt.c reads them in place)
+   //moves p over the run of up to n elements from side d of p whose data are the same distance apart in memory,
+   //returns how many with the first one's data in *base and the distance in *stride, 0 if its elements aren't inline
+   int    (*span)(IteratorG it, Pos* p, int d, int n, char const **base, long* stride);
+} IteratorOps;
+
+//hash index added by attachHashIndex() (iteratorHash.c)
+typedef struct HashIndex HashIndex;
+HashIndex* newHashIndex(ElmHashFp hashFp);  //NULL if out of memory
+void   freeHashIndex(HashIndex* h);
+int    hashReserve(IteratorG it);             //make room for the next hashAdd(), 0 if out of memory
+void   hashAdd(IteratorG it, void** slot);     //index the element in slot, after hashReserve() or hashRemove()
+void   hashRemove(IteratorG it, void** slot);  //forget the element in slot, before it is removed or changed
+void   hashRehash(IteratorG it);               //every slot may hold a different element now, rehash them all
+void** hashFind(IteratorG it, void const *key); //slot of the first element in reading order equal to key, NULL if none
+int    hashCount(IteratorG it, void const *key);
+
+//epochs for concurrent iterators made by makeConcurrent() (iteratorRcu.c)
+//the writer retires what it unlinks and readers pin the epoch they start reading in,
+//anything retired is reclaimed once no reader pinned before it was unlinked
+typedef struct Rcu Rcu;
+typedef struct Reader Reader;
+Rcu* newRcu(int fwd);                 //readers will read in direction fwd, NULL if out of memory
+void freeRcu(IteratorG it, Rcu* r);   //reclaims everything still retired, there must be no readers left
+int  rcuReaderFwd(Rcu* r);
+Reader* rcuJoin(Rcu* r);              //a new reader with the current epoch pinned, NULL if out of memory
+void rcuLeave(Rcu* r, Reader* rd);
+void rcuPin(Rcu* r, Reader* rd);      //the reader lets go of everything it had and starts again
+int  rcuReserve(Rcu* r, int n);       //make sure the next n retirements have a record, 0 if out of memory
+void rcuRetire(IteratorG it, void* p, void (*reclaim)(IteratorG it, void* p));  //call reclaim(it, p) once no reader can reach p, after rcuReserve()
+
+//staging queue added by attachStaging() (iteratorQueue.c)
+typedef struct Staging Staging;
+void freeStaging(IteratorG it, Staging* q);  //frees whatever is still staged
+
+//helpers for building the result of a find() in other files (iteratorG.c)
+IteratorG newIteratorLike(IteratorG it);     //an empty list with the same backend and element functions
+int  gatherAhead(IteratorG it, void** out, int max);  //move it over up to max elements, storing them in out, returns how many
+int  appendMatches(IteratorG it, void** elems, char const *pass, int n);  //copy each elems[i] with pass[i] set onto the end, 0 if out of memory
+//add the n pointer elements in elems, made by newElm already, as addMany would without copying them again
+//returns how many went in, the caller still owns the rest (iteratorG.c)
+int  addAdopted(IteratorG it, void** elems, int n);
+//call work on each of the n jobs size bytes apart, all but the first on threads of their own (iteratorSort.c)
+//jobs that no thread could be started for are done by the calling thread afterwards
+void runJobs(void* (*work)(void* job), void* jobs, size_t size, int n);
+
+struct IteratorGRep {
+   const IteratorOps* ops;
+   void* store;  //backend specific
+   Pos curs;     //the cursor, always a position inside store
+   int size;     //number of elements in the list, -1 if not known yet (filters)
+   int index;    //number of elements before the cursor, -1 if not known yet (filters, or after findValue())
+   int fwd;      //the direction next() moves in, reverse() flips it between NEXT and PREV
+   int sorted;   //1 if the elements are kept in cmpElm order (physical order, so reversed lists read them descending)
+   int view;     //1 if store belongs to the iterator this one was advanced from or filters
+   Pos vends[2]; //for a view, the positions before its first and after its last element (physical order)
+   int filtered; //1 for iterators made by filter(), filt is only used then
+   Filter filt;
+   HashIndex* hash;  //NULL unless attachHashIndex() was called, views never have one
+   Rcu* rcu;         //NULL unless makeConcurrent() was called, views never have one
+   Staging* staging; //NULL unless attachStaging() was called, views never have one
+#ifdef ITERATORG_STATS
+   IteratorStats* stats;  //shared with the views made from it
+#endif
+
+   ElmCompareFp cmpElm;
+   ElmNewFp newElm;
+   ElmFreeFp freeElm;
+   size_t elemSize;  //0 for pointer elements, otherwise elements are copied into the list nodes
+                     //if newElm is set too, elements are strings and only those shorter than elemSize go in the nodes
+};
+
+//the element functions, counted
+static inline void* callNew(IteratorG it, void const *vp){
+   STAT(it, newCalls, 1);
+   return it->newElm(vp);
+}
+static inline void callFree(IteratorG it, void *vp){
+   STAT(it, freeCalls, 1);
+   it->freeElm(vp);
+}
+static inline int callCmp(IteratorG it, void const *e1, void const *e2){
+   STAT(it, cmpCalls, 1);
+   return it->cmpElm(e1, e2);
+}
+
+//just the cursor part of an iterator, the list is whatever it has
+struct CursorGRep {
+   IteratorG it;
+   Pos curs;
+   int index;
+   int raw;  //filt.raw, when it is a filter
+   int fwd;
+   Reader* reader;  //for cursors of concurrent iterators, which read the list by its links alone
+};
+
+extern const IteratorOps unrolledOps;
+extern const IteratorOps treeOps;
+extern const IteratorOps mappedOps;
+
+int  mappedOpen(IteratorG it, char const *path);  //map a file written by saveIterator() into an empty mapped store, 0 on failure
+
+#endif
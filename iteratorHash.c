@@ -0,0 +1,213 @@
+/* iteratorHash.c
+   Hash index for the generic Iterator
+
+   attachHashIndex() gives an iterator a chained hash table from element
+   values to the slots holding them. add(), del() and set() keep it up to
+   date, so findValue() and countValue() don't have to scan the list. Only
+   backends whose slots stay put while other elements come and go (the ones
+   with a locate operation) can be indexed. Among equal elements findValue()
+   picks the one first in reading order, just as a scan would, by rank where
+   the backend has it and otherwise by walking from the start to the first
+   of them.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "iteratorGRep.h"
+
+#define HASH_MIN_BUCKETS 16
+
+typedef struct Entry {
+   struct Entry* next;
+   void** slot;         //where the element keeps its data
+   unsigned hash;       //hash of *slot, so rehashing never calls hashElm again
+   int mark;            //set on the matches while hashFind() works out which comes first
+} Entry;
+
+struct HashIndex {
+   ElmHashFp hashElm;
+   Entry** buckets;
+   unsigned nbuckets;   //always a power of two
+   int count;
+   Entry* spare;        //an entry hashReserve() or hashRemove() kept for the next hashAdd()
+};
+
+//mix the bits so clustered hashes still spread over the buckets
+static unsigned bucketOf(HashIndex* h, unsigned hash){
+   hash ^= hash >> 16;
+   hash *= 0x45d9f3bu;
+   hash ^= hash >> 16;
+   return hash & (h->nbuckets - 1);
+}
+
+//double the bucket array once there are more entries than buckets
+//if that can't be allocated the chains just get longer
+static void grow(HashIndex* h){
+   unsigned n = h->nbuckets * 2;
+   Entry** buckets = calloc(n, sizeof(Entry*));
+   if(buckets == NULL) return;
+   Entry** old = h->buckets;
+   unsigned oldn = h->nbuckets;
+   h->buckets = buckets;
+   h->nbuckets = n;
+   unsigned i;
+   for(i = 0; i < oldn; i++){
+      Entry* e = old[i];
+      while(e != NULL){
+         Entry* tmp = e->next;
+         unsigned b = bucketOf(h, e->hash);
+         e->next = buckets[b];
+         buckets[b] = e;
+         e = tmp;
+      }
+   }
+   free(old);
+}
+
+HashIndex* newHashIndex(ElmHashFp hashFp){
+   HashIndex* h = malloc(sizeof(HashIndex));
+   if(h == NULL) return NULL;
+   h->buckets = calloc(HASH_MIN_BUCKETS, sizeof(Entry*));
+   if(h->buckets == NULL){
+      free(h);
+      return NULL;
+   }
+   h->hashElm = hashFp;
+   h->nbuckets = HASH_MIN_BUCKETS;
+   h->count = 0;
+   h->spare = NULL;
+   return h;
+}
+
+void freeHashIndex(HashIndex* h){
+   unsigned i;
+   for(i = 0; i < h->nbuckets; i++){
+      Entry* e = h->buckets[i];
+      while(e != NULL){
+         Entry* tmp = e->next;
+         free(e);
+         e = tmp;
+      }
+   }
+   free(h->buckets);
+   free(h->spare);
+   free(h);
+}
+
+int  hashReserve(IteratorG it){
+   HashIndex* h = it->hash;
+   if(h->spare == NULL) h->spare = malloc(sizeof(Entry));
+   return h->spare != NULL;
+}
+
+static void linkEntry(HashIndex* h, Entry* e){
+   unsigned b = bucketOf(h, e->hash);
+   e->next = h->buckets[b];
+   h->buckets[b] = e;
+}
+
+void hashAdd(IteratorG it, void** slot){
+   HashIndex* h = it->hash;
+   Entry* e = h->spare;
+   h->spare = NULL;
+   e->slot = slot;
+   e->hash = h->hashElm(*slot);
+   e->mark = 0;
+   if(h->count >= h->nbuckets) grow(h);
+   linkEntry(h, e);
+   h->count++;
+}
+
+void hashRemove(IteratorG it, void** slot){
+   HashIndex* h = it->hash;
+   Entry** prev = &h->buckets[bucketOf(h, h->hashElm(*slot))];
+   while((*prev)->slot != slot){
+      prev = &(*prev)->next;
+   }
+   Entry* e = *prev;
+   *prev = e->next;
+   //kept for the next hashAdd(), so set() can put its element back without allocating
+   if(h->spare == NULL){
+      h->spare = e;
+   }else{
+      free(e);
+   }
+   h->count--;
+}
+
+void hashRehash(IteratorG it){
+   HashIndex* h = it->hash;
+   Entry* all = NULL;
+   unsigned i;
+   for(i = 0; i < h->nbuckets; i++){
+      while(h->buckets[i] != NULL){
+         Entry* e = h->buckets[i];
+         h->buckets[i] = e->next;
+         e->next = all;
+         all = e;
+      }
+   }
+   while(all != NULL){
+      Entry* e = all;
+      all = e->next;
+      e->hash = h->hashElm(*e->slot);
+      linkEntry(h, e);
+   }
+}
+
+//whether slot holds one of the marked matches
+static int marked(HashIndex* h, void** slot, unsigned hash){
+   Entry* e;
+   for(e = h->buckets[bucketOf(h, hash)]; e != NULL; e = e->next){
+      if(e->slot == slot) return e->mark;
+   }
+   return 0;
+}
+
+void** hashFind(IteratorG it, void const *key){
+   HashIndex* h = it->hash;
+   unsigned hash = h->hashElm(key);
+   Entry* chain = h->buckets[bucketOf(h, hash)];
+   Entry* best = NULL;
+   int matches = 0;
+   Entry* e;
+   for(e = chain; e != NULL; e = e->next){
+      e->mark = (e->hash == hash && callCmp(it, *e->slot, key) == 0);
+      if(e->mark && best == NULL) best = e;
+      matches += e->mark;
+   }
+   if(matches <= 1) return (best != NULL) ? best->slot : NULL;
+
+   void** slot;
+   if(it->ops->rank != NULL){
+      //the first in reading order is the lowest ranked, or the highest once reversed
+      int bestRank = it->ops->rank(it, it->ops->locate(it, best->slot));
+      for(e = chain; e != NULL; e = e->next){
+         if(!e->mark) continue;
+         int r = it->ops->rank(it, it->ops->locate(it, e->slot));
+         if((it->fwd == NEXT) ? r < bestRank : r > bestRank){
+            best = e;
+            bestRank = r;
+         }
+      }
+      slot = best->slot;
+   }else{
+      //otherwise the elements are walked from the start until one of them turns up
+      Pos p = it->ops->end(it, !it->fwd);
+      while(!marked(h, slot = it->ops->slot(it, p, it->fwd), hash)){
+         it->ops->step(it, &p, it->fwd);
+      }
+   }
+   return slot;
+}
+
+int hashCount(IteratorG it, void const *key){
+   HashIndex* h = it->hash;
+   unsigned hash = h->hashElm(key);
+   int count = 0;
+   Entry* e;
+   for(e = h->buckets[bucketOf(h, hash)]; e != NULL; e = e->next){
+      if(e->hash == hash && callCmp(it, *e->slot, key) == 0) count++;
+   }
+   return count;
+}
@@ -0,0 +1,324 @@
+/* iteratorIngest.c
+   Filling an Iterator straight from a file descriptor
+
+   A reader thread fills one of two INGEST_CHUNK buffers with read() while the
+   calling thread parses the other and adds what it finds, so the I/O and the
+   node building overlap. Each read is handed over as soon as it returns, so a
+   slow pipe or socket is added as it arrives rather than a chunk at a time.
+   Parsed elements go in INGEST_BATCH at a time through addMany, so the list
+   backend allocates their nodes in blocks. Only the two buffers, a batch (and
+   a line that doesn't fit in a buffer) are held on top of the list itself.
+
+   The reader only calls read() once poll() says there is input, and the
+   parser can wake it from poll(), so it is always stopped and joined before
+   ingestInts/ingestStrings return. Nothing reads the fd after that, but the
+   reader may already have read past a bad int by then.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <poll.h>
+#include "iteratorGRep.h"
+
+#define INGEST_CHUNK (1 << 20)
+#define INGEST_BATCH 4096   //elements are handed to addMany this many at a time
+
+#define EMPTY -2            //Pipe.len of a buffer waiting to be filled
+
+//shared by the parser and the reader thread
+typedef struct Pipe {
+   int fd;
+   int wake[2];             //the parser closes wake[1] to get the reader out of poll()
+   char* buf[2];
+   ssize_t len[2];          //bytes in each buffer, 0 at the end of the input, -1 if read failed
+   int stop;                //set when the parser is done, at the end of the input or early
+   pthread_mutex_t lock;
+   pthread_cond_t cond;
+} Pipe;
+
+typedef struct Ingest {
+   IteratorG it;
+   int count;               //elements added so far
+   int failed;
+   //ints being parsed, a number can be split between two chunks
+   int ints[INGEST_BATCH];
+   int nints;
+   //strings made by newElm but not added yet, for lists of pointer elements
+   void* lines[INGEST_BATCH];
+   int nlines;
+   int inNumber;
+   int negative;
+   int digits;              //whether the number has any yet, "-" alone is not a number
+   long long value;
+   //the start of a line cut off by the end of a chunk
+   char* carry;
+   size_t carryLen;
+   size_t carryCap;
+} Ingest;
+
+
+//whatever one read() gives, so the parser gets data as soon as it arrives
+static ssize_t readChunk(int fd, char* buf){
+   ssize_t n;
+   do{
+      n = read(fd, buf, INGEST_CHUNK);
+   }while(n < 0 && errno == EINTR);
+   return (n < 0) ? -1 : n;
+}
+
+//whether fd has input (or has ended) rather than the parser having closed wake[1]
+static int waitInput(Pipe* p){
+   struct pollfd fds[2] = { { p->fd, POLLIN, 0 }, { p->wake[0], POLLIN, 0 } };
+   int r;
+   do{
+      r = poll(fds, 2, -1);
+   }while(r < 0 && errno == EINTR);
+   //if poll itself fails, read() is left to block or report the error
+   return r < 0 || fds[1].revents == 0;
+}
+
+static void freePipe(Pipe* p){
+   if(p->wake[0] >= 0) close(p->wake[0]);
+   if(p->wake[1] >= 0) close(p->wake[1]);
+   pthread_mutex_destroy(&p->lock);
+   pthread_cond_destroy(&p->cond);
+   free(p->buf[0]);
+   free(p->buf[1]);
+   free(p);
+}
+
+static void* reader(void* arg){
+   Pipe* p = arg;
+   int i;
+   for(i = 0; ; i = !i){
+      pthread_mutex_lock(&p->lock);
+      while(p->len[i] != EMPTY && !p->stop){
+         pthread_cond_wait(&p->cond, &p->lock);
+      }
+      int stop = p->stop;
+      pthread_mutex_unlock(&p->lock);
+      if(stop || !waitInput(p)) break;
+
+      ssize_t n = readChunk(p->fd, p->buf[i]);
+      pthread_mutex_lock(&p->lock);
+      p->len[i] = n;
+      stop = p->stop;
+      pthread_cond_broadcast(&p->cond);
+      pthread_mutex_unlock(&p->lock);
+      if(n <= 0 || stop) break;
+   }
+   return NULL;
+}
+
+//also called after a bad int, the ones before it still go in
+static void flushInts(Ingest* in){
+   if(in->nints == 0) return;
+   if(addMany(in->it, in->ints, in->nints, sizeof(int))){
+      in->count += in->nints;
+   }else{
+      in->failed = 1;
+   }
+   in->nints = 0;
+}
+
+static void endNumber(Ingest* in){
+   if(!in->inNumber) return;
+   if(!in->digits){
+      in->failed = 1;
+      return;
+   }
+   in->ints[in->nints++] = in->negative ? -in->value : in->value;
+   in->inNumber = 0;
+   if(in->nints == INGEST_BATCH) flushInts(in);
+}
+
+//ints are separated by whitespace, anything else is an error
+static void parseInts(Ingest* in, char* buf, ssize_t n){
+   ssize_t i;
+   for(i = 0; i < n && !in->failed; i++){
+      char c = buf[i];
+      if(c >= '0' && c <= '9'){
+         if(!in->inNumber){
+            in->inNumber = 1;
+            in->negative = 0;
+            in->value = 0;
+         }
+         in->digits = 1;
+         in->value = in->value * 10 + (c - '0');
+         if(in->value > (long long) INT_MAX + in->negative) in->failed = 1;
+      }else if(c == '-' && !in->inNumber){
+         in->inNumber = 1;
+         in->negative = 1;
+         in->digits = 0;
+         in->value = 0;
+      }else if(c == ' ' || c == '\n' || c == '\t' || c == '\r'){
+         endNumber(in);
+      }else{
+         in->failed = 1;
+      }
+   }
+}
+
+static void finishInts(Ingest* in){
+   //a number cut short by an error is dropped
+   if(!in->failed) endNumber(in);
+   flushInts(in);
+}
+
+static void flushLines(Ingest* in){
+   if(in->nlines == 0) return;
+   int added = addAdopted(in->it, in->lines, in->nlines);
+   in->count += added;
+   if(added < in->nlines) in->failed = 1;
+   //whatever didn't make it in is still ours to free
+   while(added < in->nlines){
+      callFree(in->it, in->lines[added++]);
+   }
+   in->nlines = 0;
+}
+
+static void addLine(Ingest* in, char* line){
+   if(in->failed) return;
+   IteratorG it = in->it;
+   //strings kept in list nodes are copied into each node as it is made, so only pointer elements are batched
+   if(it->elemSize > 0 || it->ops->insert == NULL){
+      if(add(it, line)){
+         in->count++;
+      }else{
+         in->failed = 1;
+      }
+      return;
+   }
+   //the line is copied now, the buffer it is in goes back to the reader before the batch is added
+   void* elem = callNew(it, line);
+   if(elem == NULL){
+      in->failed = 1;
+      return;
+   }
+   in->lines[in->nlines++] = elem;
+   if(in->nlines == INGEST_BATCH) flushLines(in);
+}
+
+static int appendCarry(Ingest* in, char const *s, size_t n){
+   if(in->carryLen + n + 1 > in->carryCap){
+      size_t cap = (in->carryLen + n + 1) * 2;
+      char* carry = realloc(in->carry, cap);
+      if(carry == NULL) return 0;
+      in->carry = carry;
+      in->carryCap = cap;
+   }
+   memcpy(in->carry + in->carryLen, s, n);
+   in->carryLen += n;
+   in->carry[in->carryLen] = '\0';
+   return 1;
+}
+
+//one string per line, the newlines are turned into the strings' terminators in place
+static void parseLines(Ingest* in, char* buf, ssize_t n){
+   char* end = buf + n;
+   char* line = buf;
+   char* nl;
+   while(!in->failed && (nl = memchr(line, '\n', end - line)) != NULL){
+      *nl = '\0';
+      if(in->carryLen > 0){
+         //this finishes a line the last chunk started
+         if(!appendCarry(in, line, nl - line)){
+            in->failed = 1;
+            break;
+         }
+         addLine(in, in->carry);
+         in->carryLen = 0;
+      }else{
+         addLine(in, line);
+      }
+      line = nl + 1;
+   }
+   if(!in->failed && line < end && !appendCarry(in, line, end - line)) in->failed = 1;
+}
+
+static void finishLines(Ingest* in){
+   //the last line need not end in a newline
+   if(!in->failed && in->carryLen > 0) addLine(in, in->carry);
+   flushLines(in);
+}
+
+static int ingest(IteratorG it, int fd, void (*parse)(Ingest* in, char* buf, ssize_t n), void (*finish)(Ingest* in)){
+   Pipe* p = malloc(sizeof(Pipe));
+   Ingest* in = calloc(1, sizeof(Ingest));
+   char* buf[2] = { malloc(INGEST_CHUNK), malloc(INGEST_CHUNK) };
+   if(p == NULL || in == NULL || buf[0] == NULL || buf[1] == NULL){
+      free(p);
+      free(in);
+      free(buf[0]);
+      free(buf[1]);
+      return -1;
+   }
+   *p = (Pipe) { fd, { -1, -1 }, { buf[0], buf[1] }, { EMPTY, EMPTY }, 0,
+                 PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+   in->it = it;
+
+   //without a reader thread the chunks are read in turn with the parsing
+   pthread_t thread;
+   int threaded = 0;
+   if(pipe(p->wake) == 0){
+      threaded = (pthread_create(&thread, NULL, reader, p) == 0);
+   }else{
+      p->wake[0] = p->wake[1] = -1;
+   }
+   int i;
+   ssize_t n;
+   for(i = 0; ; i = !i){
+      if(threaded){
+         pthread_mutex_lock(&p->lock);
+         while(p->len[i] == EMPTY){
+            pthread_cond_wait(&p->cond, &p->lock);
+         }
+         n = p->len[i];
+         pthread_mutex_unlock(&p->lock);
+      }else{
+         n = readChunk(fd, p->buf[i]);
+      }
+      if(n < 0) in->failed = 1;
+      if(n <= 0) break;
+
+      parse(in, p->buf[i], n);
+      if(in->failed) break;
+
+      //hand the buffer back to the reader
+      pthread_mutex_lock(&p->lock);
+      p->len[i] = EMPTY;
+      pthread_cond_broadcast(&p->cond);
+      pthread_mutex_unlock(&p->lock);
+   }
+   //even after an error, what was parsed before it goes in
+   finish(in);
+   if(threaded){
+      pthread_mutex_lock(&p->lock);
+      p->stop = 1;
+      pthread_cond_broadcast(&p->cond);
+      pthread_mutex_unlock(&p->lock);
+      //a reader waiting in poll() for input that may never come sees wake[0] close, so the join can't hang
+      close(p->wake[1]);
+      p->wake[1] = -1;
+      pthread_join(thread, NULL);
+   }
+   freePipe(p);
+
+   int result = in->failed ? -1 : in->count;
+   free(in->carry);
+   free(in);
+   return result;
+}
+
+int  ingestInts(IteratorG it, int fd){
+   return ingest(it, fd, parseInts, finishInts);
+}
+
+int  ingestStrings(IteratorG it, int fd){
+   return ingest(it, fd, parseLines, finishLines);
+}
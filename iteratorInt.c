@@ -0,0 +1,247 @@
+/* iteratorInt.c
+   Built in filters for iterators of ints, those made with positiveIntType
+   or newIteratorInline(sizeof(int), ...)
+
+   Instead of calling a predicate through a function pointer for every element,
+   the elements ahead of the cursor are taken INT_BLOCK at a time and tested
+   together by a kernel using AVX2 or SSE4.1, whichever the cpu has, or plain C.
+   Inline ints in list nodes made one after another are evenly spaced in the
+   node pool, so the kernels read them where they are (AVX2 gathers them) and
+   only follow the links to check the spacing. Other elements have their
+   pointers gathered and their values copied into a buffer first.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <limits.h>
+#include <immintrin.h>
+#include "iteratorGRep.h"
+
+#define INT_BLOCK 1024
+
+//the ints a kernel works on, v[i] is at base + i * stride
+//pass[i] is set to whether v[i] is in [lo, hi], pass may be NULL when only the count is wanted
+typedef int (*RangeKernel)(char const *base, long stride, int n, int lo, int hi, char* pass);
+typedef long long (*SumKernel)(char const *base, long stride, int n);
+
+static inline int intAt(char const *base, long stride, int i){
+   return * (int const *) (base + stride * i);
+}
+
+
+static int rangeScalar(char const *base, long stride, int n, int lo, int hi, char* pass){
+   int count = 0;
+   int i;
+   for(i = 0; i < n; i++){
+      int v = intAt(base, stride, i);
+      int in = (v >= lo && v <= hi);
+      if(pass != NULL) pass[i] = in;
+      count += in;
+   }
+   return count;
+}
+
+static long long sumScalar(char const *base, long stride, int n){
+   long long sum = 0;
+   int i;
+   for(i = 0; i < n; i++){
+      sum += intAt(base, stride, i);
+   }
+   return sum;
+}
+
+//spread the low width bits of mask over pass
+static void storeMask(char* pass, int mask, int width){
+   int j;
+   for(j = 0; j < width; j++){
+      pass[j] = (mask >> j) & 1;
+   }
+}
+
+//four ints from base + i * stride on, in one load when they are packed together
+__attribute__((target("sse4.1")))
+static inline __m128i loadSse(char const *base, long stride, int i){
+   if(stride == sizeof(int)) return _mm_loadu_si128((__m128i const *) (base + stride * i));
+   return _mm_setr_epi32(intAt(base, stride, i), intAt(base, stride, i + 1), intAt(base, stride, i + 2), intAt(base, stride, i + 3));
+}
+
+__attribute__((target("sse4.1")))
+static int rangeSse(char const *base, long stride, int n, int lo, int hi, char* pass){
+   __m128i vlo = _mm_set1_epi32(lo);
+   __m128i vhi = _mm_set1_epi32(hi);
+   int count = 0;
+   int i;
+   for(i = 0; i + 4 <= n; i += 4){
+      __m128i x = loadSse(base, stride, i);
+      //a lane is out of range if lo > x or x > hi
+      __m128i out = _mm_or_si128(_mm_cmpgt_epi32(vlo, x), _mm_cmpgt_epi32(x, vhi));
+      int mask = ~_mm_movemask_ps(_mm_castsi128_ps(out)) & 0xf;
+      count += __builtin_popcount(mask);
+      if(pass != NULL) storeMask(pass + i, mask, 4);
+   }
+   return count + rangeScalar(base + stride * i, stride, n - i, lo, hi, (pass != NULL) ? pass + i : NULL);
+}
+
+__attribute__((target("sse4.1")))
+static long long sumSse(char const *base, long stride, int n){
+   //the ints are widened to 64 bits so the sum can't overflow
+   __m128i acc = _mm_setzero_si128();
+   int i;
+   for(i = 0; i + 4 <= n; i += 4){
+      __m128i x = loadSse(base, stride, i);
+      acc = _mm_add_epi64(acc, _mm_cvtepi32_epi64(x));
+      acc = _mm_add_epi64(acc, _mm_cvtepi32_epi64(_mm_srli_si128(x, 8)));
+   }
+   long long lanes[2];
+   _mm_storeu_si128((__m128i*) lanes, acc);
+   return lanes[0] + lanes[1] + sumScalar(base + stride * i, stride, n - i);
+}
+
+//eight ints from base + i * stride on, gathered straight out of their nodes unless they are packed together
+__attribute__((target("avx2")))
+static inline __m256i loadAvx2(char const *base, long stride, int i, __m256i offsets){
+   if(stride == sizeof(int)) return _mm256_loadu_si256((__m256i const *) (base + stride * i));
+   return _mm256_i32gather_epi32((int const *) (base + stride * i), offsets, 1);
+}
+
+__attribute__((target("avx2")))
+static int rangeAvx2(char const *base, long stride, int n, int lo, int hi, char* pass){
+   __m256i vlo = _mm256_set1_epi32(lo);
+   __m256i vhi = _mm256_set1_epi32(hi);
+   __m256i offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32((int) stride));
+   int count = 0;
+   int i;
+   for(i = 0; i + 8 <= n; i += 8){
+      __m256i x = loadAvx2(base, stride, i, offsets);
+      __m256i out = _mm256_or_si256(_mm256_cmpgt_epi32(vlo, x), _mm256_cmpgt_epi32(x, vhi));
+      int mask = ~_mm256_movemask_ps(_mm256_castsi256_ps(out)) & 0xff;
+      count += __builtin_popcount(mask);
+      if(pass != NULL) storeMask(pass + i, mask, 8);
+   }
+   return count + rangeScalar(base + stride * i, stride, n - i, lo, hi, (pass != NULL) ? pass + i : NULL);
+}
+
+__attribute__((target("avx2")))
+static long long sumAvx2(char const *base, long stride, int n){
+   __m256i offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32((int) stride));
+   __m256i acc = _mm256_setzero_si256();
+   int i;
+   for(i = 0; i + 8 <= n; i += 8){
+      __m256i x = loadAvx2(base, stride, i, offsets);
+      acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(x)));
+      acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(x, 1)));
+   }
+   long long lanes[4];
+   _mm256_storeu_si256((__m256i*) lanes, acc);
+   return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sumScalar(base + stride * i, stride, n - i);
+}
+
+static RangeKernel rangeKernel = rangeScalar;
+static SumKernel sumKernel = sumScalar;
+
+//picked once at load time, so the kernels never change while threads might be using them
+__attribute__((constructor))
+static void pickKernels(void){
+   __builtin_cpu_init();
+   if(__builtin_cpu_supports("avx2")){
+      rangeKernel = rangeAvx2;
+      sumKernel = sumAvx2;
+   }else if(__builtin_cpu_supports("sse4.1")){
+      rangeKernel = rangeSse;
+      sumKernel = sumSse;
+   }
+}
+
+//the ints a kernel gets next, from the nodes themselves or else copied into vals
+typedef struct Block {
+   char const *base;
+   long stride;
+   int n;
+} Block;
+
+//the next block of elements ahead of walker's cursor, 0 once there are none
+static int nextBlock(IteratorG walker, Block* b, int* vals){
+   if(!walker->filtered && walker->ops->span != NULL){
+      int left = distanceToEnd(walker);
+      b->n = walker->ops->span(walker, &walker->curs, walker->fwd, (left < INT_BLOCK) ? left : INT_BLOCK, &b->base, &b->stride);
+      if(b->n > 0){
+         walker->index += b->n;
+         return b->n;
+      }
+   }
+   void* elems[INT_BLOCK];
+   b->n = gatherAhead(walker, elems, INT_BLOCK);
+   int i;
+   for(i = 0; i < b->n; i++){
+      vals[i] = * (int *) elems[i];
+   }
+   b->base = (char const *) vals;
+   b->stride = sizeof(int);
+   return b->n;
+}
+
+//put copies of the n ints in vals on the end of it, in order
+static int appendInts(IteratorG it, int* vals, int n){
+   if(it->ops->insertMany != NULL){
+      //inserting on the PREV side leaves the cursor after the new elements
+      if(!it->ops->insertMany(it, &it->curs, PREV, vals, n, sizeof(int))) return 0;
+   }else{
+      int i;
+      for(i = 0; i < n; i++){
+         if(!it->ops->insert(it, &it->curs, PREV, &vals[i])) return 0;
+      }
+   }
+   it->size += n;
+   it->index += n;
+   return 1;
+}
+
+IteratorG findRange(IteratorG it, int lo, int hi){
+   int vals[INT_BLOCK];
+   char pass[INT_BLOCK];
+   struct IteratorGRep walker = *it;
+   IteratorG findsnew = newIteratorLike(it);
+   if(findsnew == NULL) return NULL;
+   Block b;
+   while(nextBlock(&walker, &b, vals) > 0){
+      if(rangeKernel(b.base, b.stride, b.n, lo, hi, pass) == 0) continue;
+      //squeeze the matches up to the front of vals so the whole block goes in at once
+      int i, m = 0;
+      for(i = 0; i < b.n; i++){
+         vals[m] = intAt(b.base, b.stride, i);
+         m += pass[i];
+      }
+      if(!appendInts(findsnew, vals, m)){
+         freeIt(findsnew);
+         return NULL;
+      }
+   }
+   reset(findsnew);
+   return findsnew;
+}
+
+IteratorG findGreaterEq(IteratorG it, int min){
+   return findRange(it, min, INT_MAX);
+}
+
+int countRange(IteratorG it, int lo, int hi){
+   int vals[INT_BLOCK];
+   struct IteratorGRep walker = *it;
+   int count = 0;
+   Block b;
+   while(nextBlock(&walker, &b, vals) > 0){
+      count += rangeKernel(b.base, b.stride, b.n, lo, hi, NULL);
+   }
+   return count;
+}
+
+long long sumInts(IteratorG it){
+   int vals[INT_BLOCK];
+   struct IteratorGRep walker = *it;
+   long long sum = 0;
+   Block b;
+   while(nextBlock(&walker, &b, vals) > 0){
+      sum += sumKernel(b.base, b.stride, b.n);
+   }
+   return sum;
+}
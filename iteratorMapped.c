@@ -0,0 +1,179 @@
+/* iteratorMapped.c
+   Saved iterator files, and the read only backend that maps them
+
+   A file written by saveIterator() is a FileHeader, then count + 1 offsets
+   (from the start of the file) and then the elements' bytes, each starting
+   on an 8 byte boundary. Element i runs from offsets[i] up to offsets[i + 1].
+   loadIterator() maps the file and the backend below hands out pointers
+   straight into the mapping, so nothing is read or copied until it is used.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "iteratorGRep.h"
+
+#define FILE_MAGIC "ITRG"
+#define FILE_VERSION 1
+#define FILE_ALIGN 8
+
+typedef struct FileHeader {
+   char magic[4];
+   uint32_t version;
+   uint64_t count;
+} FileHeader;
+
+typedef struct MappedStore {
+   char const *base;  //the mapping, NULL while empty
+   size_t length;
+   int count;
+   uint64_t const *offsets;
+   void* scratch;     //slot() has nowhere else to point at
+} MappedStore;
+
+//a Pos is the index of the element infront of the cursor (off), node is not used
+
+
+static size_t padded(size_t n){
+   return (n + FILE_ALIGN - 1) / FILE_ALIGN * FILE_ALIGN;
+}
+
+int  saveIterator(IteratorG it, char const *path, ElmSizeFp sizeFp){
+   //the whole list is saved in reading order, wherever the cursor is
+   struct IteratorGRep walker = *it;
+   reset(&walker);
+   int n = distanceToEnd(&walker);
+   void** elems = malloc(n * sizeof(void*) + 1);
+   uint64_t* offsets = malloc((n + 1) * sizeof(uint64_t));
+   FILE* fp = fopen(path, "wb");
+   int ok = (elems != NULL && offsets != NULL && fp != NULL);
+   if(ok){
+      gatherAhead(&walker, elems, n);
+      FileHeader h = { FILE_MAGIC, FILE_VERSION, n };
+      uint64_t at = padded(sizeof(FileHeader) + (n + 1) * sizeof(uint64_t));
+      int i;
+      for(i = 0; i < n; i++){
+         offsets[i] = at;
+         at += padded(sizeFp(elems[i]));
+      }
+      offsets[n] = at;
+      ok = fwrite(&h, sizeof(h), 1, fp) == 1 && fwrite(offsets, sizeof(uint64_t), n + 1, fp) == n + 1;
+      static const char zeros[FILE_ALIGN];
+      size_t pad = offsets[0] - sizeof(FileHeader) - (n + 1) * sizeof(uint64_t);
+      ok = ok && fwrite(zeros, 1, pad, fp) == pad;
+      for(i = 0; ok && i < n; i++){
+         size_t size = sizeFp(elems[i]);
+         pad = offsets[i + 1] - offsets[i] - size;
+         ok = fwrite(elems[i], 1, size, fp) == size && fwrite(zeros, 1, pad, fp) == pad;
+      }
+   }
+   if(fp != NULL && fclose(fp) != 0) ok = 0;
+   free(elems);
+   free(offsets);
+   return ok;
+}
+
+int  mappedOpen(IteratorG it, char const *path){
+   MappedStore* ms = it->store;
+   int fd = open(path, O_RDONLY);
+   if(fd < 0) return 0;
+   struct stat st;
+   void* base = MAP_FAILED;
+   if(fstat(fd, &st) == 0 && st.st_size >= sizeof(FileHeader)){
+      base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   }
+   //the mapping keeps the file open by itself
+   close(fd);
+   if(base == MAP_FAILED) return 0;
+
+   //check the file is one of ours and every element lies inside it before trusting the offsets
+   FileHeader const *h = base;
+   uint64_t length = st.st_size;
+   int ok = memcmp(h->magic, FILE_MAGIC, 4) == 0 && h->version == FILE_VERSION && h->count < INT32_MAX
+            && sizeof(FileHeader) + (h->count + 1) * sizeof(uint64_t) <= length;
+   uint64_t const *offsets = (uint64_t const *) (h + 1);
+   uint64_t i;
+   for(i = 0; ok && i < h->count; i++){
+      ok = offsets[i] <= offsets[i + 1] && offsets[i] % FILE_ALIGN == 0;
+   }
+   if(!ok || offsets[h->count] > length){
+      munmap(base, st.st_size);
+      return 0;
+   }
+   ms->base = base;
+   ms->length = st.st_size;
+   ms->count = h->count;
+   ms->offsets = offsets;
+   return 1;
+}
+
+static int mappedInit(IteratorG it){
+   MappedStore* ms = malloc(sizeof(MappedStore));
+   if(ms == NULL) return 0;
+   ms->base = NULL;
+   ms->length = 0;
+   ms->count = 0;
+   ms->offsets = NULL;
+   it->store = ms;
+   return 1;
+}
+
+static void mappedDestroy(IteratorG it){
+   MappedStore* ms = it->store;
+   //the elements belong to the file, there is nothing to free but the mapping
+   if(ms->base != NULL) munmap((void*) ms->base, ms->length);
+   free(ms);
+}
+
+static Pos mappedEnd(IteratorG it, int d){
+   MappedStore* ms = it->store;
+   Pos p = { NULL, (d == NEXT) ? ms->count : 0 };
+   return p;
+}
+
+static void* elemAt(MappedStore* ms, int i){
+   return (void*) (ms->base + ms->offsets[i]);
+}
+
+static void** mappedSlot(IteratorG it, Pos p, int d){
+   MappedStore* ms = it->store;
+   int i = (d == NEXT) ? p.off : p.off - 1;
+   if(i < 0 || i >= ms->count) return NULL;
+   ms->scratch = elemAt(ms, i);
+   return &ms->scratch;
+}
+
+static void* mappedStep(IteratorG it, Pos* p, int d){
+   MappedStore* ms = it->store;
+   STAT(it, hops, 1);
+   return (d == NEXT) ? elemAt(ms, p->off++) : elemAt(ms, --p->off);
+}
+
+static int mappedRank(IteratorG it, Pos p){
+   return p.off;
+}
+
+static Pos mappedSeek(IteratorG it, int index){
+   Pos p = { NULL, index };
+   return p;
+}
+
+static void mappedGather(IteratorG it, Pos* p, int d, void** out, int n){
+   MappedStore* ms = it->store;
+   int i;
+   STAT(it, hops, n);
+   for(i = 0; i < n; i++){
+      out[i] = (d == NEXT) ? elemAt(ms, p->off++) : elemAt(ms, --p->off);
+   }
+}
+
+//no insert or remove, so the iterator functions treat it as read only
+const IteratorOps mappedOps = {
+   mappedInit, mappedDestroy, mappedEnd, mappedSlot, mappedStep, NULL, NULL, NULL,
+   mappedRank, mappedSeek, NULL, NULL, mappedGather, NULL, NULL
+};
@@ -0,0 +1,119 @@
+/* iteratorQueue.c
+   Staging queue for adding elements from other threads
+
+   attachStaging() gives an iterator a queue any thread can stage() elements
+   on without a lock. Staged elements are copied straight away and pushed on
+   a stack with a compare and swap. drainInto() takes the whole stack with one
+   exchange, so the thread that owns the iterator gets every element staged so
+   far at once and only ever competes with the producers on that one word.
+   Nothing is ever popped singly, so the stack can't suffer from ABA.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "iteratorGRep.h"
+
+typedef struct Staged {
+   struct Staged* next;
+   void* elem;       //the element made by newElm, or payload
+   char payload[];   //the element's bytes for iterators that keep elements in their nodes
+} Staged;
+
+struct Staging {
+   Staged* head;     //the latest staged element
+};
+
+
+int  attachStaging(IteratorG it){
+   if(it->view || it->ops->insert == NULL) return 0;
+   if(it->staging != NULL) return 1;
+   Staging* q = malloc(sizeof(Staging));
+   if(q == NULL) return 0;
+   q->head = NULL;
+   it->staging = q;
+   return 1;
+}
+
+int  stage(IteratorG it, void *vp){
+   Staging* q = it->staging;
+   if(q == NULL) return 0;
+   //the copy is made now since vp might not last until the drain
+   //elements that will end up in a node go in as bytes, add() copies them from there
+   size_t bytes = 0;
+   if(it->elemSize > 0) bytes = (it->newElm == NULL) ? it->elemSize : strlen(vp) + 1;
+   Staged* s = malloc(sizeof(Staged) + bytes);
+   if(s == NULL) return 0;
+   if(it->elemSize > 0){
+      memcpy(s->payload, vp, bytes);
+      s->elem = s->payload;
+   }else{
+      s->elem = it->newElm(vp);  //counted when drainInto() adopts it
+   }
+   s->next = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+   while(!__atomic_compare_exchange_n(&q->head, &s->next, s, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+   return 1;
+}
+
+int  drainInto(IteratorG it){
+   Staging* q = it->staging;
+   if(q == NULL) return -1;
+   Staged* s = __atomic_exchange_n(&q->head, NULL, __ATOMIC_ACQUIRE);
+   //the stack has the latest element first, turn it round so they go in the order they were staged
+   Staged* batch = NULL;
+   int n = 0;
+   while(s != NULL){
+      Staged* tmp = s->next;
+      s->next = batch;
+      batch = s;
+      s = tmp;
+      n++;
+   }
+   if(n == 0) return 0;
+
+   int added = 0;
+   if(it->elemSize == 0){
+      //pointer elements were made by newElm already, so they are adopted rather than copied again
+      void** elems = malloc(n * sizeof(void*));
+      if(elems != NULL){
+         int i = 0;
+         for(s = batch; s != NULL; s = s->next){
+            elems[i++] = s->elem;
+         }
+         added = addAdopted(it, elems, n);
+         free(elems);
+      }else{
+         //no room for the array, so they go in one at a time
+         for(s = batch; s != NULL && addAdopted(it, &s->elem, 1); s = s->next){
+            added++;
+         }
+      }
+      //whatever didn't make it in is still the queue's to free
+      int i = 0;
+      for(s = batch; s != NULL; s = s->next){
+         if(i++ >= added) callFree(it, s->elem);
+      }
+   }else{
+      for(s = batch; s != NULL && add(it, s->elem); s = s->next){
+         added++;
+      }
+   }
+
+   while(batch != NULL){
+      Staged* tmp = batch->next;
+      free(batch);
+      batch = tmp;
+   }
+   return (added == n) ? n : -1;
+}
+
+void freeStaging(IteratorG it, Staging* q){
+   Staged* s = q->head;
+   while(s != NULL){
+      Staged* tmp = s->next;
+      if(it->elemSize == 0) callFree(it, s->elem);
+      free(s);
+      s = tmp;
+   }
+   free(q);
+}
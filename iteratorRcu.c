@@ -0,0 +1,176 @@
+/* iteratorRcu.c
+   Epochs for lists read by many threads while one thread changes them
+
+   After makeConcurrent() the writer's del() and set() don't free the node or
+   element they take out of the list straight away. It is retired with the
+   epoch it was unlinked in and only reclaimed once every reader has started
+   reading after that, so a reader that was already looking at it can carry on.
+   Readers just announce the epoch they started in and never wait, the mutex
+   is only taken to add or drop a reader and when the writer checks what can
+   be reclaimed. The writer reserves the records it will retire with before it
+   unlinks anything, so running out of memory makes del() or set() fail rather
+   than wait on readers that might never move on.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <limits.h>
+#include <pthread.h>
+#include "iteratorGRep.h"
+
+#define RCU_BATCH 64   //the writer checks what it can reclaim every this many retirements
+
+typedef struct Retired {
+   struct Retired* next;
+   void* p;
+   void (*reclaim)(IteratorG it, void* p);
+   unsigned long epoch;   //the epoch once p was unlinked, readers at it or later can't reach p
+} Retired;
+
+struct Reader {
+   struct Reader* next;
+   unsigned long epoch;   //the epoch this reader started reading in, 0 while it is joining
+};
+
+struct Rcu {
+   unsigned long epoch;   //starts at 1, the writer bumps it after each unlink
+   int fwd;               //the direction readers read in
+   pthread_mutex_t lock;  //guards readers
+   Reader* readers;
+   //only the writer touches these
+   Retired* retired;      //newest first, so the epochs go down along the chain
+   int nretired;
+   Retired* spare;        //records rcuReserve() set aside, chained through next
+   int nspare;
+   int reclaimAt;         //when to check again, later if a slow reader held lots back last time
+};
+
+
+Rcu* newRcu(int fwd){
+   Rcu* r = malloc(sizeof(Rcu));
+   if(r == NULL) return NULL;
+   r->epoch = 1;
+   r->fwd = fwd;
+   pthread_mutex_init(&r->lock, NULL);
+   r->readers = NULL;
+   r->retired = NULL;
+   r->nretired = 0;
+   r->spare = NULL;
+   r->nspare = 0;
+   r->reclaimAt = RCU_BATCH;
+   return r;
+}
+
+static void reclaimFrom(IteratorG it, Retired* e){
+   while(e != NULL){
+      Retired* tmp = e->next;
+      e->reclaim(it, e->p);
+      free(e);
+      e = tmp;
+   }
+}
+
+void freeRcu(IteratorG it, Rcu* r){
+   //every reader is gone by now, so everything retired can go
+   reclaimFrom(it, r->retired);
+   while(r->spare != NULL){
+      Retired* tmp = r->spare->next;
+      free(r->spare);
+      r->spare = tmp;
+   }
+   pthread_mutex_destroy(&r->lock);
+   free(r);
+}
+
+int  rcuReaderFwd(Rcu* r){
+   return r->fwd;
+}
+
+Reader* rcuJoin(Rcu* r){
+   Reader* rd = malloc(sizeof(Reader));
+   if(rd == NULL) return NULL;
+   //a joining reader holds back every retirement until it has pinned an epoch,
+   //otherwise the writer could miss it between it reading the epoch and being listed
+   rd->epoch = 0;
+   pthread_mutex_lock(&r->lock);
+   rd->next = r->readers;
+   r->readers = rd;
+   pthread_mutex_unlock(&r->lock);
+   rcuPin(r, rd);
+   return rd;
+}
+
+void rcuLeave(Rcu* r, Reader* rd){
+   pthread_mutex_lock(&r->lock);
+   Reader** pp = &r->readers;
+   while(*pp != rd){
+      pp = &(*pp)->next;
+   }
+   *pp = rd->next;
+   pthread_mutex_unlock(&r->lock);
+   free(rd);
+}
+
+void rcuPin(Rcu* r, Reader* rd){
+   //the epoch must still be current once announced, so the writer either sees the announcement
+   //or bumped the epoch after it, in which case this reader sees its unlinks
+   unsigned long e;
+   do{
+      e = __atomic_load_n(&r->epoch, __ATOMIC_SEQ_CST);
+      __atomic_store_n(&rd->epoch, e, __ATOMIC_SEQ_CST);
+   }while(__atomic_load_n(&r->epoch, __ATOMIC_SEQ_CST) != e);
+}
+
+//the epoch of the reader that started reading first, ULONG_MAX if there are none
+static unsigned long oldestReader(Rcu* r){
+   unsigned long oldest = ULONG_MAX;
+   pthread_mutex_lock(&r->lock);
+   Reader* rd;
+   for(rd = r->readers; rd != NULL; rd = rd->next){
+      unsigned long e = __atomic_load_n(&rd->epoch, __ATOMIC_SEQ_CST);
+      if(e < oldest) oldest = e;
+   }
+   pthread_mutex_unlock(&r->lock);
+   return oldest;
+}
+
+//reclaim everything no reader can still be looking at
+static void reclaimOld(IteratorG it, Rcu* r){
+   unsigned long oldest = oldestReader(r);
+   Retired** pp = &r->retired;
+   while(*pp != NULL && (*pp)->epoch > oldest){
+      pp = &(*pp)->next;
+   }
+   Retired* e = *pp;
+   *pp = NULL;
+   for(r->nretired = 0, pp = &r->retired; *pp != NULL; pp = &(*pp)->next){
+      r->nretired++;
+   }
+   r->reclaimAt = (r->nretired * 2 > RCU_BATCH) ? r->nretired * 2 : RCU_BATCH;
+   reclaimFrom(it, e);
+}
+
+int  rcuReserve(Rcu* r, int n){
+   while(r->nspare < n){
+      Retired* e = malloc(sizeof(Retired));
+      if(e == NULL) return 0;
+      e->next = r->spare;
+      r->spare = e;
+      r->nspare++;
+   }
+   return 1;
+}
+
+void rcuRetire(IteratorG it, void* p, void (*reclaim)(IteratorG it, void* p)){
+   Rcu* r = it->rcu;
+   unsigned long epoch = __atomic_add_fetch(&r->epoch, 1, __ATOMIC_SEQ_CST);
+   Retired* e = r->spare;
+   r->spare = e->next;
+   r->nspare--;
+   e->p = p;
+   e->reclaim = reclaim;
+   e->epoch = epoch;
+   e->next = r->retired;
+   r->retired = e;
+   if(++r->nretired >= r->reclaimAt) reclaimOld(it, r);
+}
@@ -0,0 +1,149 @@
+/* iteratorSort.c
+   Sorting an Iterator in place with a stable merge sort
+
+   The list is cut into one run per thread, each run is sorted on a thread of
+   its own and then neighbouring runs are merged in pairs, every pair of a
+   round on its own thread, until one run is left. Elements are never copied:
+   backends with a sort op relink their nodes, the others have the element
+   pointers gathered into an array, sorted there and written back into the
+   same slots in their new order.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "iteratorGRep.h"
+
+#define SORT_CHUNK 4096   //no thread is started for fewer elements than this
+
+typedef struct SortJob {
+   IteratorG it;
+   void** elems;
+   void** tmp;       //as long as elems, merges go through it
+   int lo, mid, hi;  //the job sorts elems[lo..hi), or merges elems[lo..mid) with elems[mid..hi)
+} SortJob;
+
+
+void runJobs(void* (*work)(void* job), void* jobs, size_t size, int n){
+   if(n <= 0) return;
+   //the calling thread does the first job itself, so only n - 1 are started
+   pthread_t* threads = (n > 1) ? malloc((n - 1) * sizeof(pthread_t)) : NULL;
+   int started = 0;
+   while(threads != NULL && started < n - 1
+         && pthread_create(&threads[started], NULL, work, (char*) jobs + (started + 1) * size) == 0){
+      started++;
+   }
+   work(jobs);
+   int i;
+   for(i = started + 1; i < n; i++){
+      work((char*) jobs + i * size);
+   }
+   for(i = 0; i < started; i++){
+      pthread_join(threads[i], NULL);
+   }
+   free(threads);
+}
+
+//merges elems[lo..mid) and elems[mid..hi) back into elems, the first run's elements go first among equal ones
+static void mergeRuns(IteratorG it, void** elems, void** tmp, int lo, int mid, int hi){
+   int i = lo, j = mid, k = lo;
+   while(i < mid && j < hi){
+      tmp[k++] = (callCmp(it, elems[j], elems[i]) < 0) ? elems[j++] : elems[i++];
+   }
+   while(i < mid){
+      tmp[k++] = elems[i++];
+   }
+   //whatever is left of the second run is in place already
+   memcpy(elems + lo, tmp + lo, (k - lo) * sizeof(void*));
+}
+
+static void mergeSort(IteratorG it, void** elems, void** tmp, int lo, int hi){
+   if(hi - lo < 2) return;
+   int mid = lo + (hi - lo) / 2;
+   mergeSort(it, elems, tmp, lo, mid);
+   mergeSort(it, elems, tmp, mid, hi);
+   mergeRuns(it, elems, tmp, lo, mid, hi);
+}
+
+static void* sortJob(void* arg){
+   SortJob* job = arg;
+   mergeSort(job->it, job->elems, job->tmp, job->lo, job->hi);
+   return NULL;
+}
+
+static void* mergeJob(void* arg){
+   SortJob* job = arg;
+   mergeRuns(job->it, job->elems, job->tmp, job->lo, job->mid, job->hi);
+   return NULL;
+}
+
+//the sort for backends without a sort op, the pointers are sorted in an array and put back slot by slot
+static int sortSlots(IteratorG it, int nthreads){
+   int n = it->size;
+   void** elems = malloc(n * sizeof(void*) + 1);
+   void** tmp = malloc(n * sizeof(void*) + 1);
+   SortJob* jobs = malloc(nthreads * sizeof(SortJob));
+   if(elems == NULL || tmp == NULL || jobs == NULL){
+      free(elems);
+      free(tmp);
+      free(jobs);
+      return 0;
+   }
+   struct IteratorGRep walker = *it;
+   reset(&walker);
+   gatherAhead(&walker, elems, n);
+
+   int k;
+   for(k = 0; k < nthreads; k++){
+      jobs[k].it = it;
+      jobs[k].elems = elems;
+      jobs[k].tmp = tmp;
+      jobs[k].lo = (int) ((long long) n * k / nthreads);
+      jobs[k].hi = (int) ((long long) n * (k + 1) / nthreads);
+   }
+   runJobs(sortJob, jobs, sizeof(SortJob), nthreads);
+   int runs = nthreads;
+   while(runs > 1){
+      int pairs = runs / 2;
+      for(k = 0; k < pairs; k++){
+         int lo = jobs[2 * k].lo;
+         jobs[k] = jobs[2 * k + 1];
+         jobs[k].mid = jobs[k].lo;
+         jobs[k].lo = lo;
+      }
+      runJobs(mergeJob, jobs, sizeof(SortJob), pairs);
+      if(runs % 2 == 1) jobs[pairs] = jobs[runs - 1];
+      runs = pairs + runs % 2;
+   }
+
+   Pos p = it->ops->end(it, !it->fwd);
+   for(k = 0; k < n; k++){
+      *it->ops->slot(it, p, it->fwd) = elems[k];
+      it->ops->step(it, &p, it->fwd);
+   }
+   //the hash index finds elements by their slot, and the slots hold different elements now
+   if(it->hash != NULL) hashRehash(it);
+   free(elems);
+   free(tmp);
+   free(jobs);
+   return 1;
+}
+
+int  sortIt(IteratorG it){
+   return sortItParallel(it, 1);
+}
+
+int  sortItParallel(IteratorG it, int nthreads){
+   if(it->view && !materialize(it)) return 0;
+   //readers of a concurrent list follow its links without waiting, so they can't be relinked under them
+   if(it->ops->insert == NULL || it->rcu != NULL) return 0;
+   //a sorted list is in order already, and can't be put in descending order while it reads reversed
+   if(it->sorted) return it->fwd == NEXT;
+   int n = it->size;
+   if(nthreads > n / SORT_CHUNK) nthreads = n / SORT_CHUNK;
+   if(nthreads < 1) nthreads = 1;
+   int ok = (it->ops->sort != NULL) ? it->ops->sort(it, it->fwd, nthreads) : sortSlots(it, nthreads);
+   reset(it);
+   return ok;
+}
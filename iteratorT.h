@@ -0,0 +1,197 @@
+// iteratorT.h ... type specialised Iterator, generated by a macro
+//
+// DEFINE_ITERATOR(Name, T, cmp) defines the type NameIterator, a list of T's
+// stored by value in the nodes, and static inline functions NameIterator_add,
+// NameIterator_next and so on with the same meaning as the iteratorG.h ones.
+// cmp is called as cmp(T a, T b) and returns <0, 0 or >0 like ElmCompareFp,
+// it is a macro argument so it gets inlined rather than called through a pointer.
+//
+// e.g.   static inline int intCmp(int a, int b){ return (a > b) - (a < b); }
+//        DEFINE_ITERATOR(Int, int, intCmp)
+//        IntIterator* it = IntIterator_new();
+//        IntIterator_add(it, 42);
+//
+// next() and previous() return a pointer to the element inside its node, valid until it
+// is deleted. Nothing is copied or freed beyond the T itself, so a T that owns memory
+// (a char*) is up to the caller.
+// iteratorG.h is still there for lists of mixed or run time types.
+
+#ifndef ITERATORT_H
+#define ITERATORT_H
+
+#include <stdlib.h>
+#include <assert.h>
+
+#define DEFINE_ITERATOR(Name, T, cmp)                                                   \
+                                                                                        \
+typedef struct Name##Node {                                                             \
+   T val;                                                                               \
+   struct Name##Node* link[2];  /* link[0] is the previous node, link[1] the next */    \
+} Name##Node;                                                                           \
+                                                                                        \
+typedef struct Name##Iterator {                                                         \
+   Name##Node* mtstart;  /* empty nodes at either end, like the list backend */         \
+   Name##Node* mtend;                                                                   \
+   Name##Node* curs;     /* the node infront of the cursor (physical order) */          \
+   int size;                                                                            \
+   int index;            /* number of elements before the cursor */                     \
+   int fwd;              /* 1 normally, 0 once reversed */                              \
+} Name##Iterator;                                                                       \
+                                                                                        \
+static inline Name##Iterator* Name##Iterator_new(void){                                 \
+   Name##Iterator* it = malloc(sizeof(Name##Iterator));                                 \
+   assert (it != NULL);                                                                 \
+   it->mtstart = malloc(sizeof(Name##Node));                                            \
+   it->mtend = malloc(sizeof(Name##Node));                                              \
+   assert (it->mtstart != NULL && it->mtend != NULL);                                   \
+   it->mtstart->link[0] = NULL;                                                         \
+   it->mtstart->link[1] = it->mtend;                                                    \
+   it->mtend->link[0] = it->mtstart;                                                    \
+   it->mtend->link[1] = NULL;                                                           \
+   it->curs = it->mtend;                                                                \
+   it->size = it->index = 0;                                                            \
+   it->fwd = 1;                                                                         \
+   return it;                                                                           \
+}                                                                                       \
+                                                                                        \
+static inline void Name##Iterator_free(Name##Iterator* it){                             \
+   Name##Node* n = it->mtstart;                                                         \
+   while(n != NULL){                                                                    \
+      Name##Node* tmp = n->link[1];                                                     \
+      free(n);                                                                          \
+      n = tmp;                                                                          \
+   }                                                                                    \
+   free(it);                                                                            \
+}                                                                                       \
+                                                                                        \
+/* v goes just after the cursor, so next() returns it */                                \
+static inline int Name##Iterator_add(Name##Iterator* it, T v){                          \
+   Name##Node* new = malloc(sizeof(Name##Node));                                        \
+   if(new == NULL) return 0;                                                            \
+   new->val = v;                                                                        \
+   new->link[0] = it->curs->link[0];                                                    \
+   new->link[1] = it->curs;                                                             \
+   it->curs->link[0]->link[1] = new;                                                    \
+   it->curs->link[0] = new;                                                             \
+   if(it->fwd) it->curs = new;                                                          \
+   it->size++;                                                                          \
+   return 1;                                                                            \
+}                                                                                       \
+                                                                                        \
+static inline int Name##Iterator_hasNext(Name##Iterator* it){                           \
+   return it->index < it->size;                                                         \
+}                                                                                       \
+                                                                                        \
+static inline int Name##Iterator_hasPrevious(Name##Iterator* it){                       \
+   return it->index > 0;                                                                \
+}                                                                                       \
+                                                                                        \
+/* move the cursor over the element on physical side d */                               \
+static inline T* Name##Iterator_step(Name##Iterator* it, int d){                        \
+   Name##Node* n = it->curs;                                                            \
+   if(d){                                                                               \
+      it->curs = n->link[1];                                                            \
+      return &n->val;                                                                   \
+   }                                                                                    \
+   it->curs = n->link[0];                                                               \
+   return &it->curs->val;                                                               \
+}                                                                                       \
+                                                                                        \
+static inline T* Name##Iterator_next(Name##Iterator* it){                               \
+   if(!Name##Iterator_hasNext(it)) return NULL;                                         \
+   it->index++;                                                                         \
+   return Name##Iterator_step(it, it->fwd);                                             \
+}                                                                                       \
+                                                                                        \
+static inline T* Name##Iterator_previous(Name##Iterator* it){                           \
+   if(!Name##Iterator_hasPrevious(it)) return NULL;                                     \
+   it->index--;                                                                         \
+   return Name##Iterator_step(it, !it->fwd);                                            \
+}                                                                                       \
+                                                                                        \
+/* deletes the element previous() would return */                                       \
+static inline int Name##Iterator_del(Name##Iterator* it){                               \
+   if(!Name##Iterator_hasPrevious(it)) return 0;                                        \
+   Name##Node* n = it->fwd ? it->curs->link[0] : it->curs;                              \
+   if(!it->fwd) it->curs = n->link[1];                                                  \
+   n->link[0]->link[1] = n->link[1];                                                    \
+   n->link[1]->link[0] = n->link[0];                                                    \
+   free(n);                                                                             \
+   it->size--;                                                                          \
+   it->index--;                                                                         \
+   return 1;                                                                            \
+}                                                                                       \
+                                                                                        \
+/* replaces the element previous() would return */                                      \
+static inline int Name##Iterator_set(Name##Iterator* it, T v){                          \
+   if(!Name##Iterator_hasPrevious(it)) return 0;                                        \
+   Name##Node* n = it->fwd ? it->curs->link[0] : it->curs;                              \
+   n->val = v;                                                                          \
+   return 1;                                                                            \
+}                                                                                       \
+                                                                                        \
+/* like reverse() in iteratorG.c, a cursor at either end goes to the other end */       \
+/* and one in between walks back to the same distance from the start */                 \
+static inline void Name##Iterator_reverse(Name##Iterator* it){                          \
+   int index = it->index;                                                               \
+   it->fwd = !it->fwd;                                                                  \
+   it->index = it->size - it->index;                                                    \
+   if(index == 0 || index == it->size) return;                                          \
+   while(it->index < index) Name##Iterator_next(it);                                    \
+   while(it->index > index) Name##Iterator_previous(it);                                \
+}                                                                                       \
+                                                                                        \
+static inline void Name##Iterator_reset(Name##Iterator* it){                            \
+   it->curs = it->fwd ? it->mtstart->link[1] : it->mtend;                               \
+   it->index = 0;                                                                       \
+}                                                                                       \
+                                                                                        \
+static inline int Name##Iterator_distanceFromStart(Name##Iterator* it){                 \
+   return it->index;                                                                    \
+}                                                                                       \
+                                                                                        \
+static inline int Name##Iterator_distanceToEnd(Name##Iterator* it){                     \
+   return it->size - it->index;                                                         \
+}                                                                                       \
+                                                                                        \
+static inline int Name##Iterator_size(Name##Iterator* it){                              \
+   return it->size;                                                                     \
+}                                                                                       \
+                                                                                        \
+/* moves the cursor to just before the first element equal to key, 0 if none */       \
+static inline int Name##Iterator_findValue(Name##Iterator* it, T key){                  \
+   Name##Node* save = it->curs;                                                         \
+   int index = it->index;                                                               \
+   Name##Iterator_reset(it);                                                            \
+   while(Name##Iterator_hasNext(it)){                                                   \
+      if(cmp(*Name##Iterator_next(it), key) == 0){                                      \
+         Name##Iterator_previous(it);                                                   \
+         return 1;                                                                      \
+      }                                                                                 \
+   }                                                                                    \
+   it->curs = save;                                                                     \
+   it->index = index;                                                                   \
+   return 0;                                                                            \
+}                                                                                       \
+                                                                                        \
+/* the elements from the cursor to the end that fp accepts, copied into a new list */   \
+static inline Name##Iterator* Name##Iterator_find(Name##Iterator* it,                   \
+                                                  int (*fp)(T const *vp)){              \
+   Name##Iterator* found = Name##Iterator_new();                                        \
+   Name##Node* n = it->curs;                                                            \
+   int i;                                                                               \
+   for(i = it->index; i < it->size; i++){                                               \
+      T* v = it->fwd ? &n->val : &n->link[0]->val;                                      \
+      n = n->link[it->fwd];                                                             \
+      if(fp(v)){                                                                        \
+         /* adding while reversed puts each new element after the one before it */      \
+         found->fwd = 0;                                                                \
+         Name##Iterator_add(found, *v);                                                 \
+         found->fwd = 1;                                                                \
+      }                                                                                 \
+   }                                                                                    \
+   Name##Iterator_reset(found);                                                         \
+   return found;                                                                        \
+}
+
+#endif
@@ -0,0 +1,261 @@
+/* iteratorTree.c
+   Order statistic tree backend for the generic Iterator
+
+   Elements are kept in list order in a treap (a binary search tree balanced
+   by random node priorities). Every node knows how many nodes are in its
+   subtree, so the position of an element, and the element at a position,
+   can be found in O(log n). Stepping the cursor follows parent links and
+   is O(1) amortised over a walk through the list.
+
+   Sorted iterators use this backend with list order matching cmpElm order,
+   so the tree doubles as a binary search tree for treeBound.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include "iteratorGRep.h"
+
+typedef struct TNode {
+   void* data;
+   struct TNode* child[2];  //child[PREV] holds the elements before this one, child[NEXT] those after it
+   struct TNode* parent;
+   int count;               //number of nodes in this subtree
+   unsigned prio;           //a node's priority is never lower than its children's
+} TNode;
+
+typedef struct TreeStore {
+   TNode* root;
+   unsigned seed;  //state of the priority generator
+} TreeStore;
+
+//a Pos is the node of the element infront of the cursor, or NULL when the cursor is at the end
+
+
+static int countOf(TNode* n){
+   return (n == NULL) ? 0 : n->count;
+}
+
+//xorshift, good enough to keep the tree balanced
+static unsigned nextPrio(TreeStore* ts){
+   ts->seed ^= ts->seed << 13;
+   ts->seed ^= ts->seed >> 17;
+   ts->seed ^= ts->seed << 5;
+   return ts->seed;
+}
+
+//the first (d = PREV) or last (d = NEXT) node of the subtree under n
+static TNode* extreme(TNode* n, int d){
+   if(n == NULL) return NULL;
+   while(n->child[d] != NULL){
+      n = n->child[d];
+   }
+   return n;
+}
+
+//the node after (d = NEXT) or before (d = PREV) n in list order
+static TNode* neighbour(TNode* n, int d){
+   if(n->child[d] != NULL) return extreme(n->child[d], !d);
+   while(n->parent != NULL && n == n->parent->child[d]){
+      n = n->parent;
+   }
+   return n->parent;
+}
+
+//the node behind position p
+static TNode* behind(TreeStore* ts, Pos p){
+   return (p.node != NULL) ? neighbour(p.node, PREV) : extreme(ts->root, NEXT);
+}
+
+static void replaceChild(TreeStore* ts, TNode* parent, TNode* old, TNode* new){
+   if(parent == NULL){
+      ts->root = new;
+   }else{
+      parent->child[parent->child[NEXT] == old] = new;
+   }
+   if(new != NULL) new->parent = parent;
+}
+
+//lift c above its parent, keeping list order
+static void rotateUp(TreeStore* ts, TNode* c){
+   TNode* x = c->parent;
+   int d = (x->child[NEXT] == c);
+   x->child[d] = c->child[!d];
+   if(x->child[d] != NULL) x->child[d]->parent = x;
+   replaceChild(ts, x->parent, x, c);
+   c->child[!d] = x;
+   x->parent = c;
+   x->count = 1 + countOf(x->child[PREV]) + countOf(x->child[NEXT]);
+   c->count = 1 + countOf(c->child[PREV]) + countOf(c->child[NEXT]);
+}
+
+static void freeSubtree(IteratorG it, TNode* n){
+   if(n == NULL) return;
+   freeSubtree(it, n->child[PREV]);
+   freeSubtree(it, n->child[NEXT]);
+   callFree(it, n->data);
+   STAT(it, nodesFreed, 1);
+   STAT(it, bytesInUse, -(long) sizeof(TNode));
+   free(n);
+}
+
+static int treeInit(IteratorG it){
+   TreeStore* ts = malloc(sizeof(TreeStore));
+   if(ts == NULL) return 0;
+   ts->root = NULL;
+   ts->seed = 2463534242u;
+   it->store = ts;
+   return 1;
+}
+
+static void treeDestroy(IteratorG it){
+   TreeStore* ts = it->store;
+   freeSubtree(it, ts->root);
+   free(ts);
+}
+
+static Pos treeEnd(IteratorG it, int d){
+   TreeStore* ts = it->store;
+   Pos p = { (d == PREV) ? extreme(ts->root, PREV) : NULL, 0 };
+   return p;
+}
+
+static void** treeSlot(IteratorG it, Pos p, int d){
+   TNode* n = (d == NEXT) ? p.node : behind(it->store, p);
+   return (n != NULL) ? &n->data : NULL;
+}
+
+static void* treeStep(IteratorG it, Pos* p, int d){
+   TNode* n;
+   STAT(it, hops, 1);
+   if(d == NEXT){
+      n = p->node;
+      p->node = neighbour(n, NEXT);
+      return n->data;
+   }
+   n = behind(it->store, *p);
+   p->node = n;
+   return n->data;
+}
+
+static int treeInsert(IteratorG it, Pos* p, int d, void *vp){
+   TreeStore* ts = it->store;
+   TNode* new = malloc(sizeof(TNode));
+   if(new == NULL) return 0;
+   STAT(it, nodeMallocs, 1);
+   STAT(it, nodesAllocated, 1);
+   STAT(it, bytesInUse, sizeof(TNode));
+   new->data = callNew(it, vp);
+   new->child[PREV] = new->child[NEXT] = NULL;
+   new->count = 1;
+   new->prio = nextPrio(ts);
+
+   //the new node goes in as a leaf right before the node infront of the cursor
+   TNode* at = p->node;
+   TNode* parent;
+   if(ts->root == NULL){
+      parent = NULL;
+      ts->root = new;
+   }else if(at == NULL){
+      parent = extreme(ts->root, NEXT);
+      parent->child[NEXT] = new;
+   }else if(at->child[PREV] == NULL){
+      parent = at;
+      parent->child[PREV] = new;
+   }else{
+      parent = extreme(at->child[PREV], NEXT);
+      parent->child[NEXT] = new;
+   }
+   new->parent = parent;
+   for(; parent != NULL; parent = parent->parent){
+      parent->count++;
+   }
+   //then rises until the priorities are in order again
+   while(new->parent != NULL && new->parent->prio < new->prio){
+      rotateUp(ts, new);
+   }
+
+   //inserting on the NEXT side leaves the cursor behind the new node
+   if(d == NEXT) p->node = new;
+   return 1;
+}
+
+static void* treeRemove(IteratorG it, Pos* p, int d){
+   TreeStore* ts = it->store;
+   TNode* x = (d == NEXT) ? p->node : behind(ts, *p);
+   void* data = x->data;
+   if(d == NEXT) p->node = neighbour(x, NEXT);
+
+   //sink x until it has at most one child, then splice it out
+   while(x->child[PREV] != NULL && x->child[NEXT] != NULL){
+      int d2 = (x->child[NEXT]->prio > x->child[PREV]->prio);
+      rotateUp(ts, x->child[d2]);
+   }
+   TNode* parent = x->parent;
+   replaceChild(ts, parent, x, (x->child[PREV] != NULL) ? x->child[PREV] : x->child[NEXT]);
+   for(; parent != NULL; parent = parent->parent){
+      parent->count--;
+   }
+   STAT(it, nodesFreed, 1);
+   STAT(it, bytesInUse, -(long) sizeof(TNode));
+   free(x);
+   return data;
+}
+
+static int treeRank(IteratorG it, Pos p){
+   TreeStore* ts = it->store;
+   TNode* n = p.node;
+   if(n == NULL) return countOf(ts->root);
+   int r = countOf(n->child[PREV]);
+   for(; n->parent != NULL; n = n->parent){
+      if(n == n->parent->child[NEXT]) r += countOf(n->parent->child[PREV]) + 1;
+   }
+   return r;
+}
+
+static Pos treeSeek(IteratorG it, int index){
+   TreeStore* ts = it->store;
+   TNode* n = ts->root;
+   Pos p = { NULL, 0 };
+   while(n != NULL){
+      int left = countOf(n->child[PREV]);
+      if(index < left){
+         n = n->child[PREV];
+      }else if(index == left){
+         p.node = n;
+         break;
+      }else{
+         index -= left + 1;
+         n = n->child[NEXT];
+      }
+   }
+   return p;
+}
+
+//only meaningful for sorted iterators, where list order is also cmpElm order
+static Pos treeBound(IteratorG it, void const *key, int upper){
+   TreeStore* ts = it->store;
+   TNode* n = ts->root;
+   Pos p = { NULL, 0 };
+   while(n != NULL){
+      int c = callCmp(it, n->data, key);
+      if(c > 0 || (c == 0 && !upper)){
+         p.node = n;
+         n = n->child[PREV];
+      }else{
+         n = n->child[NEXT];
+      }
+   }
+   return p;
+}
+
+static Pos treeLocate(IteratorG it, void** slot){
+   //data is the first member of a TNode
+   Pos p = { (TNode*) slot, 0 };
+   return p;
+}
+
+const IteratorOps treeOps = {
+   treeInit, treeDestroy, treeEnd, treeSlot, treeStep, treeInsert, NULL, treeRemove,
+   treeRank, treeSeek, treeBound, treeLocate, NULL, NULL, NULL
+};
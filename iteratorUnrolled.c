@@ -0,0 +1,247 @@
+/* iteratorUnrolled.c
+   Unrolled linked list backend for the generic Iterator
+
+   Elements are kept in a doubly linked list of chunks, each holding up to
+   CHUNK_CAP element pointers in order. Moving the cursor is usually just an
+   index change inside a chunk, and a full chunk is split in half when an
+   element is inserted into it.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "iteratorGRep.h"
+
+#define CHUNK_CAP 32
+
+typedef struct Chunk {
+   struct Chunk* link[2];  //link[PREV] and link[NEXT]
+   int count;
+   void* elems[CHUNK_CAP];
+} Chunk;
+
+typedef struct UnrolledStore {
+   Chunk* ends[2];  //ends[PREV] is the first chunk, ends[NEXT] the last
+} UnrolledStore;
+
+//a Pos is the chunk the cursor is in (node) and the index of the element infront of it (off)
+//chunks are never empty unless the list is, and off only equals count in the last chunk
+
+
+static Chunk* newChunk(IteratorG it){
+   Chunk* c = malloc(sizeof(Chunk));
+   if(c == NULL) return NULL;
+   STAT(it, nodeMallocs, 1);
+   STAT(it, nodesAllocated, 1);
+   STAT(it, bytesInUse, sizeof(Chunk));
+   c->link[PREV] = c->link[NEXT] = NULL;
+   c->count = 0;
+   return c;
+}
+
+//a cursor at the end of a chunk is moved to the start of the following one
+static void normalise(Pos* p){
+   Chunk* c = p->node;
+   if(p->off == c->count && c->link[NEXT] != NULL){
+      p->node = c->link[NEXT];
+      p->off = 0;
+   }
+}
+
+//unlink c from the chunk list and free it
+static void dropChunk(IteratorG it, UnrolledStore* us, Chunk* c){
+   int d;
+   for(d = PREV; d <= NEXT; d++){
+      if(c->link[d] != NULL){
+         c->link[d]->link[!d] = c->link[!d];
+      }else{
+         us->ends[d] = c->link[!d];
+      }
+   }
+   STAT(it, nodesFreed, 1);
+   STAT(it, bytesInUse, -(long) sizeof(Chunk));
+   free(c);
+}
+
+static int unrolledInit(IteratorG it){
+   UnrolledStore* us = malloc(sizeof(UnrolledStore));
+   if(us == NULL) return 0;
+   us->ends[PREV] = us->ends[NEXT] = newChunk(it);
+   if(us->ends[PREV] == NULL){
+      free(us);
+      return 0;
+   }
+   it->store = us;
+   return 1;
+}
+
+static void unrolledDestroy(IteratorG it){
+   UnrolledStore* us = it->store;
+   Chunk* c = us->ends[PREV];
+   while(c != NULL){
+      Chunk* tmp = c->link[NEXT];
+      int i;
+      for(i = 0; i < c->count; i++){
+         callFree(it, c->elems[i]);
+      }
+      STAT(it, nodesFreed, 1);
+      STAT(it, bytesInUse, -(long) sizeof(Chunk));
+      free(c);
+      c = tmp;
+   }
+   free(us);
+}
+
+static Pos unrolledEnd(IteratorG it, int d){
+   UnrolledStore* us = it->store;
+   Pos p = { us->ends[d], (d == NEXT) ? us->ends[NEXT]->count : 0 };
+   return p;
+}
+
+static void** unrolledSlot(IteratorG it, Pos p, int d){
+   Chunk* c = p.node;
+   if(d == NEXT){
+      return (p.off < c->count) ? &c->elems[p.off] : NULL;
+   }
+   if(p.off > 0) return &c->elems[p.off - 1];
+   c = c->link[PREV];
+   return (c != NULL) ? &c->elems[c->count - 1] : NULL;
+}
+
+static void* unrolledStep(IteratorG it, Pos* p, int d){
+   Chunk* c = p->node;
+   STAT(it, hops, 1);
+   if(d == NEXT){
+      void* data = c->elems[p->off++];
+      normalise(p);
+      return data;
+   }
+   if(p->off == 0){
+      c = c->link[PREV];
+      p->node = c;
+      p->off = c->count;
+   }
+   return c->elems[--p->off];
+}
+
+static int unrolledInsert(IteratorG it, Pos* p, int d, void *vp){
+   UnrolledStore* us = it->store;
+   Chunk* c = p->node;
+   int off = p->off;
+
+   //at the start of a chunk the element can go on the end of the previous one instead
+   if(off == 0 && c->link[PREV] != NULL && c->link[PREV]->count < CHUNK_CAP){
+      c = c->link[PREV];
+      off = c->count;
+   }
+   //split a full chunk in half, moving the cursor into whichever half it falls in
+   if(c->count == CHUNK_CAP){
+      Chunk* c2 = newChunk(it);
+      if(c2 == NULL) return 0;
+      int half = CHUNK_CAP / 2;
+      memcpy(c2->elems, c->elems + half, (CHUNK_CAP - half) * sizeof(void*));
+      c2->count = CHUNK_CAP - half;
+      c->count = half;
+      c2->link[PREV] = c;
+      c2->link[NEXT] = c->link[NEXT];
+      if(c->link[NEXT] != NULL){
+         c->link[NEXT]->link[PREV] = c2;
+      }else{
+         us->ends[NEXT] = c2;
+      }
+      c->link[NEXT] = c2;
+      if(off > half){
+         c = c2;
+         off -= half;
+      }
+   }
+
+   memmove(c->elems + off + 1, c->elems + off, (c->count - off) * sizeof(void*));
+   c->elems[off] = callNew(it, vp);
+   c->count++;
+
+   //inserting on the NEXT side leaves the cursor behind the new element
+   p->node = c;
+   p->off = (d == NEXT) ? off : off + 1;
+   normalise(p);
+   return 1;
+}
+
+static void* unrolledRemove(IteratorG it, Pos* p, int d){
+   UnrolledStore* us = it->store;
+   Chunk* c = p->node;
+   int off = p->off;
+
+   //the element behind a cursor at the start of a chunk is the last one of the previous chunk
+   if(d == PREV && off == 0){
+      c = c->link[PREV];
+      off = c->count;
+   }
+   if(d == PREV) off--;
+   void* data = c->elems[off];
+   memmove(c->elems + off, c->elems + off + 1, (c->count - off - 1) * sizeof(void*));
+   c->count--;
+   //either way the cursor now sits where the element was
+   p->node = c;
+   p->off = off;
+
+   Chunk* nb;
+   if(c->count == 0 && (c->link[PREV] != NULL || c->link[NEXT] != NULL)){
+      //drop an emptied chunk unless it is the only one
+      if(c->link[NEXT] != NULL){
+         p->node = c->link[NEXT];
+         p->off = 0;
+      }else{
+         p->node = c->link[PREV];
+         p->off = c->link[PREV]->count;
+      }
+      dropChunk(it, us, c);
+   }else if(c->count < CHUNK_CAP / 4){
+      //merge a sparse chunk with a neighbour it fits into
+      if((nb = c->link[NEXT]) != NULL && c->count + nb->count <= CHUNK_CAP){
+         memcpy(c->elems + c->count, nb->elems, nb->count * sizeof(void*));
+         c->count += nb->count;
+         dropChunk(it, us, nb);
+      }else if((nb = c->link[PREV]) != NULL && nb->count + c->count <= CHUNK_CAP){
+         memcpy(nb->elems + nb->count, c->elems, c->count * sizeof(void*));
+         p->node = nb;
+         p->off = nb->count + off;
+         nb->count += c->count;
+         dropChunk(it, us, c);
+      }
+   }
+   normalise(p);
+   return data;
+}
+
+static void unrolledGather(IteratorG it, Pos* p, int d, void** out, int n){
+   int i = 0;
+   STAT(it, hops, n);
+   while(i < n){
+      Chunk* c = p->node;
+      if(d == NEXT){
+         //copy as much of this chunk as is wanted in one go
+         int k = c->count - p->off;
+         if(k > n - i) k = n - i;
+         memcpy(out + i, c->elems + p->off, k * sizeof(void*));
+         p->off += k;
+         i += k;
+         normalise(p);
+      }else{
+         if(p->off == 0){
+            c = c->link[PREV];
+            p->node = c;
+            p->off = c->count;
+         }
+         while(p->off > 0 && i < n){
+            out[i++] = c->elems[--p->off];
+         }
+      }
+   }
+}
+
+const IteratorOps unrolledOps = {
+   unrolledInit, unrolledDestroy, unrolledEnd, unrolledSlot, unrolledStep,
+   unrolledInsert, NULL, unrolledRemove, NULL, NULL, NULL, NULL, unrolledGather, NULL, NULL
+};
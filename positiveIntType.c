@@ -32,5 +32,10 @@ int positiveIntCompare(void const *vp1, void const *vp2){
   return 1;
 }
 
+unsigned positiveIntHash(void const *vp){
+  return (unsigned) * (int *) vp;
+}
 
-
+size_t positiveIntSize(void const *vp){
+  return sizeof(int);
+}
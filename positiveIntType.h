@@ -12,5 +12,7 @@
 void  positiveIntFree(void *vp);
 void *positiveIntNew(void const *vp);
 int   positiveIntCompare(void const *vp1, void const *vp2);
+unsigned positiveIntHash(void const *vp);
+size_t positiveIntSize(void const *vp);
 
 /* =====   End of positiveIntType Functions for Generic interface/API ===== */
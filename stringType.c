@@ -7,6 +7,8 @@
 #include <stdio.h>
 #include <assert.h>
 #include <string.h>
+#include <stddef.h>
+#include <pthread.h>
 #include "stringType.h" 
 
 /* =====   Functions for stringType ===== */
@@ -23,5 +25,116 @@ int stringCompare(void const *vp1, void const *vp2){
   return strcmp(vp1, vp2);
 }
 
+/* FNV-1a */
+unsigned stringHash(void const *vp){
+  unsigned char const *s = vp;
+  unsigned h = 2166136261u;
+  while(*s != '\0'){
+    h ^= *s++;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+size_t stringSize(void const *vp){
+  return strlen(vp) + 1;
+}
+
+/* =====   Interned strings ===== */
+
+/* Every distinct string is kept once in a hash table, with a count of the
+   elements using it. stringInternNew hands out the shared copy and
+   stringInternFree only frees it when the last user lets go. The table is
+   shared by every iterator, so it is guarded by a mutex. */
 
+#define INTERN_MIN_BUCKETS 64
 
+typedef struct Interned {
+  struct Interned *next;
+  unsigned hash;
+  int refs;
+  char str[];
+} Interned;
+
+static struct {
+  Interned **buckets;
+  unsigned nbuckets;
+  unsigned count;
+  pthread_mutex_t lock;
+} pool = { NULL, 0, 0, PTHREAD_MUTEX_INITIALIZER };
+
+static Interned *internedOf(void const *vp){
+  return (Interned *) ((char *) vp - offsetof(Interned, str));
+}
+
+/* double the buckets once there are more strings than buckets, keep going with long chains if that fails */
+static void internGrow(void){
+  unsigned n = (pool.nbuckets == 0) ? INTERN_MIN_BUCKETS : pool.nbuckets * 2;
+  Interned **buckets = calloc(n, sizeof(Interned *));
+  if(buckets == NULL) return;
+  unsigned i;
+  for(i = 0; i < pool.nbuckets; i++){
+    Interned *e = pool.buckets[i];
+    while(e != NULL){
+      Interned *tmp = e->next;
+      e->next = buckets[e->hash & (n - 1)];
+      buckets[e->hash & (n - 1)] = e;
+      e = tmp;
+    }
+  }
+  free(pool.buckets);
+  pool.buckets = buckets;
+  pool.nbuckets = n;
+}
+
+void *stringInternNew(void const *vp){
+  unsigned hash = stringHash(vp);
+  pthread_mutex_lock(&pool.lock);
+  if(pool.count >= pool.nbuckets) internGrow();
+  Interned *e = NULL;
+  if(pool.nbuckets > 0){
+    for(e = pool.buckets[hash & (pool.nbuckets - 1)]; e != NULL; e = e->next){
+      if(e->hash == hash && strcmp(e->str, vp) == 0) break;
+    }
+  }
+  if(e != NULL){
+    e->refs++;
+  }else if(pool.nbuckets > 0 && (e = malloc(sizeof(Interned) + strlen(vp) + 1)) != NULL){
+    strcpy(e->str, vp);
+    e->hash = hash;
+    e->refs = 1;
+    e->next = pool.buckets[hash & (pool.nbuckets - 1)];
+    pool.buckets[hash & (pool.nbuckets - 1)] = e;
+    pool.count++;
+  }
+  pthread_mutex_unlock(&pool.lock);
+  return (e != NULL) ? e->str : NULL;
+}
+
+void stringInternFree(void *vp){
+  Interned *e = internedOf(vp);
+  pthread_mutex_lock(&pool.lock);
+  if(--e->refs == 0){
+    Interned **prev = &pool.buckets[e->hash & (pool.nbuckets - 1)];
+    while(*prev != e){
+      prev = &(*prev)->next;
+    }
+    *prev = e->next;
+    pool.count--;
+    free(e);
+  }
+  pthread_mutex_unlock(&pool.lock);
+}
+
+int stringInternCompare(void const *vp1, void const *vp2){
+  /* two interned copies of a string are the same pointer, but a key passed in may not be interned */
+  if(vp1 == vp2) return 0;
+  return strcmp(vp1, vp2);
+}
+
+int stringInternCount(void){
+  pthread_mutex_lock(&pool.lock);
+  int count = pool.count;
+  pthread_mutex_unlock(&pool.lock);
+  return count;
+}
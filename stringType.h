@@ -11,5 +11,14 @@
 void  stringFree(void *vp);
 void *stringNew(void const *vp);
 int   stringCompare(void const *vp1, void const *vp2);
+unsigned stringHash(void const *vp);
+size_t stringSize(void const *vp);
+
+/* the same, but equal strings share one reference counted copy
+   (pass stringInternNew/stringInternFree/stringInternCompare to newIterator, stringHash still works) */
+void *stringInternNew(void const *vp);
+void  stringInternFree(void *vp);
+int   stringInternCompare(void const *vp1, void const *vp2);
+int   stringInternCount(void);  /* number of distinct strings interned right now */
 
 /* =====   End of stringType Functions for Generic interface/API ===== */
@@ -10,9 +10,14 @@
 #include <stdio.h>
 #include <assert.h>
 #include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include "iteratorG.h"
 #include "positiveIntType.h"
 #include "stringType.h" 
+#include "iteratorT.h"
 
 #define MAXARRAY 5
 
@@ -34,6 +39,13 @@ int prefixJo(void *str){
   return (strncmp("jo", (char *) str, 2) == 0) ; 
 }
 
+/* Returns 1 if marks are even, counting how many times it is called */
+int evenCalls = 0;
+int evenMarks(void *marks){
+  evenCalls++;
+  return (*((int *) marks) % 2 == 0); 
+}
+
 /* A function to print a string from a void pointer */
 void prnStr(void *vp){
   assert(vp != NULL);
@@ -553,6 +565,964 @@ void test8(){
   
    printf("--====  End of Test-08 ====------\n\n");
 }
+
+void test9(){
+  printf("\n--====  Test-09       ====------\n");
+  IteratorG it1 = newIteratorInline(sizeof(int), positiveIntCompare);
+  int a[MAXARRAY] = { 97, 10, 61, 73, 47};
+  for(int i=0; i<MAXARRAY; i++){
+    int result = add(it1 , &a[i]); 
+    printf("> Inserting %d: %s \n", a[i], (result==1 ? "Success" : "Failed") );
+  }
+  /* elements were copied into the nodes, so changing the array must not show up */
+  a[0] = 0;
+
+  reset(it1);
+  printf("> it1 (after reset): \n");
+  prnIt(it1, prnInt);
+  reset(it1);
+
+  prnNext(it1, prnInt);
+  prnNext(it1, prnInt);
+  int newVal1 = 55;
+  int result1 = set(it1, &newVal1);
+  printf("> Set value: %d ; return val: %d \n", newVal1,  result1 );
+  newVal1 = 1;
+  prnPrev(it1, prnInt);
+
+  IteratorG findIt1 = find(it1, passMarks);
+  printf("> find(it1, passMarks) returns: \n");
+  prnIt(findIt1, prnInt);
+
+  int delResult = del(it1);
+  printf("> del(it1) returns %d: \n", delResult );
+  reset(it1);
+  prnIt(it1, prnInt);
+
+  freeIt(it1);
+  freeIt(findIt1);
+  printf("--====  End of Test-09 ====------\n\n");
+}
+
+void test10(){
+  printf("\n--====  Test-10       ====------\n");
+  IteratorG it1 = newIterator(positiveIntCompare, positiveIntNew, positiveIntFree);
+  int a[MAXARRAY] = { 5, 45, 65, 25, 85};
+  for(int i=0; i<MAXARRAY; i++){
+    int result = add(it1 , &a[i]); 
+    printf("> Inserting %d: %s \n", a[i], (result==1 ? "Success" : "Failed") );
+  }
+  reset(it1);
+  prnNext(it1, prnInt);
+
+  IteratorG advIt1 = advance(it1, 3);
+  printf("> advance(it1, 3) returns: \n");
+  prnIt(advIt1, prnInt);
+  IteratorG advIt2 = advance(advIt1, -2);
+  printf("> advance(advIt1, -2) returns: \n");
+  prnIt(advIt2, prnInt);
+
+  /* changing a view gives it its own copy, 'it1' is left alone */
+  int newVal1 = 99;
+  int result1 = set(advIt1, &newVal1);
+  printf("> Set value in advIt1: %d ; return val: %d \n", newVal1,  result1 );
+  reset(advIt1);
+  prnIt(advIt1, prnInt);
+  printf("> it1 (after reset): \n");
+  reset(it1);
+  prnIt(it1, prnInt);
+
+  reset(it1);
+  IteratorG advIt3 = advance(it1, 2);
+  result1 = materialize(advIt3);
+  printf("> materialize(advance(it1, 2)) returns %d, then freeIt(it1): \n", result1);
+  freeIt(it1);
+  prnIt(advIt3, prnInt);
+
+  freeIt(advIt1);
+  freeIt(advIt2);
+  freeIt(advIt3);
+  printf("--====  End of Test-10 ====------\n\n");
+}
+
+void test11(){
+  printf("\n--====  Test-11       ====------\n");
+  IteratorG it1 = newIterator(positiveIntCompare, positiveIntNew, positiveIntFree);
+  int a[9] = { 97, 10, 11, 56, 29, 1234, 38, 1, 542};
+  for(int i=0; i<9; i++){
+    add(it1 , &a[i]); 
+  }
+  reset(it1);
+  printf("> it1 (after reset): \n");
+  prnIt(it1, prnInt);
+  reset(it1);
+
+  /* nothing is tested until the filter is asked for an element */
+  IteratorG filtIt1 = filter(it1, evenMarks);
+  printf("> filter(it1, evenMarks) tested %d elements\n", evenCalls);
+  prnNext(filtIt1, prnInt);
+  prnNext(filtIt1, prnInt);
+  printf("> after two next() calls it has tested %d elements\n", evenCalls);
+
+  IteratorG filtIt2 = filter(filtIt1, passMarks);
+  printf("> filter(filtIt1, passMarks) returns: \n");
+  prnIt(filtIt2, prnInt);
+  prnPrev(filtIt1, prnInt);
+  printf("> distanceFromStart(filtIt1): %d, distanceToEnd(filtIt1): %d\n",
+         distanceFromStart(filtIt1), distanceToEnd(filtIt1));
+
+  printf("> In 'it1', ");
+  prnNext(it1, prnInt);
+
+  freeIt(filtIt2);
+  freeIt(filtIt1);
+  freeIt(it1);
+  printf("--====  End of Test-11 ====------\n\n");
+}
+
+void test12(){
+  printf("\n--====  Test-12       ====------\n");
+  int a[MAXARRAY] = { 25, 78, 6, 82 , 11};
+  IteratorG it1 = newIteratorFromArray(a, MAXARRAY, sizeof(int), positiveIntCompare, positiveIntNew, positiveIntFree);
+  printf("> newIteratorFromArray(a, %d, ...) gives: \n", MAXARRAY);
+  prnIt(it1, prnInt);
+  reset(it1);
+  prnNext(it1, prnInt);
+  int b[3] = { 1, 2, 3};
+  int result = addMany(it1, b, 3, sizeof(int));
+  printf("> addMany(it1, b, 3, ...) returns %d: \n", result);
+  prnIt(it1, prnInt);
+
+  IteratorG it2 = newIteratorInline(8, stringCompare);
+  char names[4][8] = { "joe", "rita", "john", "abby"};
+  result = addMany(it2, names, 4, sizeof(names[0]));
+  printf("> addMany(it2, names, 4, ...) returns %d: \n", result);
+  prnIt(it2, prnStr);
+
+  freeIt(it1);
+  freeIt(it2);
+  printf("--====  End of Test-12 ====------\n\n");
+}
+
+void test13(){
+  printf("\n--====  Test-13       ====------\n");
+  int a[MAXARRAY] = { 25, 78, 6, 82 , 11};
+  IteratorG it1 = newIteratorSorted(positiveIntCompare, positiveIntNew, positiveIntFree);
+  int i;
+  for(i = 0; i < MAXARRAY; i++){
+    add(it1, &a[i]);
+  }
+  printf("> sorted adds of 25, 78, 6, 82, 11 give: \n");
+  reset(it1);
+  prnIt(it1, prnInt);
+  int key = 30;
+  printf("> contains(it1, 30) returns %d, contains(it1, 78) returns %d \n", contains(it1, &key), contains(it1, &a[1]));
+  printf("> lowerBound(it1, 30) returns %d \n", lowerBound(it1, &key));
+  int result = seekTo(it1, &a[0]);
+  printf("> seekTo(it1, 25) returns %d \n", result);
+  prnNext(it1, prnInt);
+  key = 20;
+  result = set(it1, &key);
+  printf("> set(it1, 20) returns %d \n", result);
+  key = 99;
+  result = set(it1, &key);
+  printf("> set(it1, 99) returns %d \n", result);
+  reset(it1);
+  prnIt(it1, prnInt);
+  reverse(it1);
+  key = 15;
+  result = seekTo(it1, &key);
+  printf("> reverse, seekTo(it1, 15) returns %d \n", result);
+  prnNext(it1, prnInt);
+  freeIt(it1);
+  printf("--====  End of Test-13 ====------\n\n");
+}
+
+void test14(){
+  printf("\n--====  Test-14       ====------\n");
+  char *strA[MAXARRAY] = { "john", "rita", "john", "abby", "mark"};
+  /* unrolled lists move their elements around, so they can't have a hash index */
+  IteratorG it1 = newIteratorBackend(LIST_BACKEND, stringCompare, stringNew, stringFree);
+  int result = attachHashIndex(it1, stringHash);
+  printf("> attachHashIndex(it1, stringHash) returns %d \n", result);
+  int i;
+  for(i = 0; i < MAXARRAY; i++){
+    add(it1, strA[i]);
+  }
+  reset(it1);
+  prnIt(it1, prnStr);
+  printf("> countValue(it1, \"john\") returns %d \n", countValue(it1, "john"));
+  result = findValue(it1, "john");
+  printf("> findValue(it1, \"john\") returns %d \n", result);
+  printf("> distanceFromStart(it1) returns %d \n", distanceFromStart(it1));
+  prnNext(it1, prnStr);
+  result = set(it1, "tom");
+  printf("> set(it1, \"tom\") returns %d \n", result);
+  printf("> countValue(it1, \"john\") returns %d, countValue(it1, \"tom\") returns %d \n", countValue(it1, "john"), countValue(it1, "tom"));
+  findValue(it1, "rita");
+  next(it1);
+  del(it1);
+  printf("> findValue(it1, \"rita\"), next, del leaves: \n");
+  reset(it1);
+  prnIt(it1, prnStr);
+  printf("> findValue(it1, \"rita\") returns %d \n", findValue(it1, "rita"));
+  freeIt(it1);
+
+  /* an index only makes findValue faster, it still lands on the first equal element in reading order */
+  IteratorBackend backends[2] = { LIST_BACKEND, TREE_BACKEND };
+  char *names[2] = { "list", "tree" };
+  int a[4] = {2, 7, 1, 7};
+  int seven = 7;
+  int b;
+  for(b = 0; b < 2; b++){
+    IteratorG plain = newIteratorBackend(backends[b], positiveIntCompare, positiveIntNew, positiveIntFree);
+    IteratorG indexed = newIteratorBackend(backends[b], positiveIntCompare, positiveIntNew, positiveIntFree);
+    attachHashIndex(indexed, positiveIntHash);
+    for(i = 0; i < 4; i++){
+      add(plain, &a[i]);
+      add(indexed, &a[i]);
+    }
+    findValue(plain, &seven);
+    findValue(indexed, &seven);
+    printf("> %s: findValue(7) on 7, 1, 7, 2 leaves the cursor at %d without an index, %d with one \n",
+           names[b], distanceFromStart(plain), distanceFromStart(indexed));
+    sortIt(indexed);
+    reverse(plain);
+    findValue(plain, &seven);
+    findValue(indexed, &seven);
+    printf("> %s: reversed it is at %d, sorted with an index at %d \n", names[b], distanceFromStart(plain), distanceFromStart(indexed));
+    freeIt(plain);
+    freeIt(indexed);
+  }
+  printf("--====  End of Test-14 ====------\n\n");
+}
+
+void test15(){
+  printf("\n--====  Test-15       ====------\n");
+  IteratorG it1 = newIterator(positiveIntCompare, positiveIntNew, positiveIntFree);
+  int i, v;
+  for(i = 0; i < 20000; i++){
+    v = (i * 37) % 101;
+    add(it1, &v);
+  }
+  reset(it1);
+  next(it1);
+  IteratorG findIt1 = find(it1, passMarks);
+  IteratorG findIt2 = findParallel(it1, passMarks, 4);
+  int same = (size(findIt1) == size(findIt2));
+  while(same && hasNext(findIt1)){
+    same = (positiveIntCompare(next(findIt1), next(findIt2)) == 0);
+  }
+  printf("> find(it1, passMarks) has %d elements, findParallel(it1, passMarks, 4) has %d \n", size(findIt1), size(findIt2));
+  printf("> both have the same elements in the same order: %d \n", same);
+  reset(findIt2);
+  prnNext(findIt2, prnInt);
+  freeIt(findIt1);
+  freeIt(findIt2);
+  freeIt(it1);
+  printf("--====  End of Test-15 ====------\n\n");
+}
+
+void test16(){
+  printf("\n--====  Test-16       ====------\n");
+  IteratorG it1 = newIterator(positiveIntCompare, positiveIntNew, positiveIntFree);
+  IteratorG it2 = newIteratorInline(sizeof(int), positiveIntCompare);
+  int i, v;
+  long long sum = 0;
+  for(i = 0; i < 20000; i++){
+    v = (i * 37) % 101;
+    add(it1, &v);
+    add(it2, &v);
+    sum += v;
+  }
+  reset(it1);
+  reset(it2);
+  IteratorG findIt1 = find(it1, passMarks);
+  IteratorG findIt2 = findGreaterEq(it1, 50);
+  int same = (size(findIt1) == size(findIt2));
+  while(same && hasNext(findIt1)){
+    same = (positiveIntCompare(next(findIt1), next(findIt2)) == 0);
+  }
+  printf("> findGreaterEq(it1, 50) has %d elements, the same as find(it1, passMarks): %d \n", size(findIt2), same);
+  printf("> countRange(it1, 50, INT_MAX) returns %d \n", countRange(it1, 50, INT_MAX));
+  printf("> sumInts(it1) returns %lld, sumInts(it2) returns %lld, expected %lld \n", sumInts(it1), sumInts(it2), sum);
+  next(it2);
+  next(it2);
+  IteratorG findIt3 = findRange(it2, 10, 12);
+  printf("> findRange(it2, 10, 12) after two next() calls has %d elements: \n", size(findIt3));
+  printf("> countRange(it2, 10, 12) returns %d \n", countRange(it2, 10, 12));
+  prnNext(findIt3, prnInt);
+  prnNext(findIt3, prnInt);
+  /* it2's ints are read straight out of its nodes, deleting every third one leaves gaps between them */
+  reset(it1);
+  reset(it2);
+  for(i = 0; i < 20000; i++){
+    next(it1);
+    next(it2);
+    if(i % 3 == 0){
+      del(it1);
+      del(it2);
+    }
+  }
+  reverse(it1);
+  reverse(it2);
+  reset(it1);
+  reset(it2);
+  printf("> after deleting every third and reversing, countRange(.., 10, 60) is %d for it1 and %d for it2, sums %lld and %lld \n",
+         countRange(it1, 10, 60), countRange(it2, 10, 60), sumInts(it1), sumInts(it2));
+  freeIt(findIt1);
+  freeIt(findIt2);
+  freeIt(findIt3);
+  freeIt(it1);
+  freeIt(it2);
+  printf("--====  End of Test-16 ====------\n\n");
+}
+
+static inline int intCmp(int a, int b){
+  return (a > b) - (a < b);
+}
+
+DEFINE_ITERATOR(Int, int, intCmp)
+
+int passMarksT(int const *marks){
+  return *marks >= 50;
+}
+
+void test17(){
+  printf("\n--====  Test-17       ====------\n");
+  IntIterator* it1 = IntIterator_new();
+  int a[MAXARRAY] = { 25, 78, 6, 82 , 11};
+  int i;
+  for(i = 0; i < MAXARRAY; i++){
+    IntIterator_add(it1, a[i]);
+  }
+  IntIterator_reset(it1);
+  printf("> IntIterator it1 (after reset): \n");
+  while(IntIterator_hasNext(it1)){
+    printf(" %d ", *IntIterator_next(it1));
+  }
+  printf("\n");
+  IntIterator_reverse(it1);
+  printf("> reverse, next returns %d \n", *IntIterator_next(it1));
+  IntIterator_set(it1, 99);
+  IntIterator_next(it1);
+  IntIterator_del(it1);
+  printf("> set(it1, 99), next, del, findValue(it1, 99) returns %d \n", IntIterator_findValue(it1, 99));
+  IntIterator* it2 = IntIterator_find(it1, passMarksT);
+  printf("> find(it1, passMarksT) returns %d elements: \n", IntIterator_size(it2));
+  while(IntIterator_hasNext(it2)){
+    printf(" %d ", *IntIterator_next(it2));
+  }
+  printf("\n");
+  IntIterator_free(it1);
+  IntIterator_free(it2);
+
+  /* reversed from the same interior cursor, a generic and a typed iterator read the same */
+  IteratorG it3 = newIterator(positiveIntCompare, positiveIntNew, positiveIntFree);
+  IntIterator* it4 = IntIterator_new();
+  for(i = 0; i < MAXARRAY; i++){
+    add(it3, &a[i]);
+    IntIterator_add(it4, a[i]);
+  }
+  reset(it3);
+  IntIterator_reset(it4);
+  for(i = 0; i < 2; i++){
+    next(it3);
+    IntIterator_next(it4);
+  }
+  reverse(it3);
+  IntIterator_reverse(it4);
+  printf("> reverse at index 2, distanceFromStart is %d for it3 and %d for it4, they read: \n",
+         distanceFromStart(it3), IntIterator_distanceFromStart(it4));
+  assert(distanceFromStart(it3) == IntIterator_distanceFromStart(it4));
+  while(hasNext(it3)){
+    int *g = next(it3);
+    int *t = IntIterator_next(it4);
+    assert(t != NULL && *g == *t);
+    printf(" %d ", *t);
+  }
+  printf("\n");
+  assert(!IntIterator_hasNext(it4));
+  freeIt(it3);
+  IntIterator_free(it4);
+  printf("--====  End of Test-17 ====------\n\n");
+}
+
+void test18(){
+  printf("\n--====  Test-18       ====------\n");
+  char *strA[MAXARRAY] = { "john", "rita", "john", "abby", "rita"};
+  IteratorG it1 = newIterator(stringInternCompare, stringInternNew, stringInternFree);
+  IteratorG it2 = newIterator(stringInternCompare, stringInternNew, stringInternFree);
+  int i;
+  for(i = 0; i < MAXARRAY; i++){
+    add(it1, strA[i]);
+    add(it2, strA[i]);
+  }
+  reset(it1);
+  prnIt(it1, prnStr);
+  printf("> 10 strings added, %d distinct strings interned \n", stringInternCount());
+  reset(it1);
+  reset(it2);
+  printf("> the first elements of it1 and it2 share storage: %d \n", next(it1) == next(it2));
+  freeIt(it1);
+  printf("> after freeIt(it1), %d distinct strings interned \n", stringInternCount());
+  freeIt(it2);
+  printf("> after freeIt(it2), %d distinct strings interned \n", stringInternCount());
+  printf("--====  End of Test-18 ====------\n\n");
+}
+
+void test19(){
+  printf("\n--====  Test-19       ====------\n");
+  char *strA[MAXARRAY] = { "john", "a name longer than twenty three characters", "joe", "rita", "abby"};
+  IteratorG it1 = newIteratorStrings(stringCompare, stringNew, stringFree);
+  int i;
+  for(i = 0; i < MAXARRAY; i++){
+    add(it1, strA[i]);
+  }
+  reset(it1);
+  prnIt(it1, prnStr);
+  reset(it1);
+  next(it1);
+  set(it1, "another name longer than twenty three characters");
+  next(it1);
+  next(it1);
+  next(it1);
+  set(it1, "tom");
+  del(it1);
+  printf("> after setting the first and fourth elements and deleting the fourth: \n");
+  reset(it1);
+  prnIt(it1, prnStr);
+  reset(it1);
+  IteratorG findit = find(it1, prefixJo);
+  printf("> find(it1, prefixJo) returns: \n");
+  prnIt(findit, prnStr);
+  freeIt(findit);
+  freeIt(it1);
+  printf("--====  End of Test-19 ====------\n\n");
+}
+
+void test20(){
+  printf("\n--====  Test-20       ====------\n");
+  int a[MAXARRAY] = { 25, 78, 6, 82 , 11};
+  IteratorG it1 = newIteratorFromArray(a, MAXARRAY, sizeof(int), positiveIntCompare, positiveIntNew, positiveIntFree);
+  char *strA[MAXARRAY] = { "john", "rita", "joe", "abby", "a much longer name than the others"};
+  IteratorG it2 = newIterator(stringCompare, stringNew, stringFree);
+  int i;
+  for(i = 0; i < MAXARRAY; i++){
+    add(it2, strA[i]);
+  }
+  printf("> saveIterator(it1, ...) returns %d, saveIterator(it2, ...) returns %d \n",
+         saveIterator(it1, "test20_ints.itr", positiveIntSize), saveIterator(it2, "test20_strs.itr", stringSize));
+  freeIt(it1);
+  freeIt(it2);
+
+  IteratorG it3 = loadIterator("test20_ints.itr", positiveIntCompare, positiveIntNew, positiveIntFree);
+  IteratorG it4 = loadIterator("test20_strs.itr", stringCompare, stringNew, stringFree);
+  printf("> loadIterator gives it3 of size %d: \n", size(it3));
+  prnIt(it3, prnInt);
+  printf("> and it4 of size %d: \n", size(it4));
+  prnIt(it4, prnStr);
+  printf("> add(it4, \"tom\") returns %d \n", add(it4, "tom"));
+  reset(it3);
+  IteratorG advIt = advance(it3, 3);
+  printf("> advance(it3, 3) returns: \n");
+  prnIt(advIt, prnInt);
+  printf("> add(advIt, 25) returns %d \n", add(advIt, &a[0]));
+  reset(advIt);
+  prnIt(advIt, prnInt);
+  reset(it4);
+  IteratorG findit = find(it4, prefixJo);
+  printf("> find(it4, prefixJo) returns: \n");
+  prnIt(findit, prnStr);
+  printf("> loadIterator on a missing file returns NULL: %d \n", loadIterator("test20_none.itr", stringCompare, stringNew, stringFree) == NULL);
+  freeIt(findit);
+  freeIt(advIt);
+  freeIt(it3);
+  freeIt(it4);
+  remove("test20_ints.itr");
+  remove("test20_strs.itr");
+  printf("--====  End of Test-20 ====------\n\n");
+}
+
+/* an fd to read text from, the text has to fit in the pipe's buffer */
+int pipeOf(char *text){
+  int fds[2];
+  if(pipe(fds) != 0 || write(fds[1], text, strlen(text)) != strlen(text)){
+    perror("pipe");
+    exit(EXIT_FAILURE);
+  }
+  close(fds[1]);
+  return fds[0];
+}
+
+void test21(){
+  printf("\n--====  Test-21       ====------\n");
+  IteratorG it1 = newIterator(positiveIntCompare, positiveIntNew, positiveIntFree);
+  int fd = pipeOf("25 78\n6  82\n-11");
+  printf("> ingestInts(it1, fd) returns %d \n", ingestInts(it1, fd));
+  close(fd);
+  reset(it1);
+  prnIt(it1, prnInt);
+  fd = pipeOf("3 4x 5");
+  printf("> ingestInts on \"3 4x 5\" returns %d, the 3 before the error is kept: \n", ingestInts(it1, fd));
+  close(fd);
+  reset(it1);
+  prnIt(it1, prnInt);
+
+  /* the writer keeps the pipe open, ingestInts mustn't wait for more input once it has seen an error */
+  int fds[2];
+  assert(pipe(fds) == 0);
+  assert(write(fds[1], "1 2 - 7", 7) == 7);
+  IteratorG it3 = newIterator(positiveIntCompare, positiveIntNew, positiveIntFree);
+  printf("> ingestInts on \"1 2 - 7\" from an open pipe returns %d \n", ingestInts(it3, fds[0]));
+  reset(it3);
+  prnIt(it3, prnInt);
+  /* and nothing may go on reading the pipe after it returns, what is written next is the caller's */
+  assert(write(fds[1], "HELLO", 5) == 5);
+  fcntl(fds[0], F_SETFL, O_NONBLOCK);
+  char back[8] = "";
+  ssize_t got = read(fds[0], back, sizeof(back) - 1);
+  printf("> the caller reads back \"%s\", written to the pipe after ingestInts returned \n", got > 0 ? back : "");
+  close(fds[0]);
+  close(fds[1]);
+  freeIt(it3);
+
+  IteratorG it2 = newIteratorStrings(stringCompare, stringNew, stringFree);
+  fd = pipeOf("john\nrita\n\njoe");
+  printf("> ingestStrings(it2, fd) returns %d \n", ingestStrings(it2, fd));
+  close(fd);
+  reset(it2);
+  prnIt(it2, prnStr);
+  /* lists of pointer elements get the lines in batches through addMany */
+  IteratorG it4 = newIterator(stringCompare, stringNew, stringFree);
+  fd = pipeOf("john\nrita\n\njoe");
+  printf("> ingestStrings(it4, fd) returns %d \n", ingestStrings(it4, fd));
+  close(fd);
+  reset(it4);
+  prnIt(it4, prnStr);
+  freeIt(it1);
+  freeIt(it2);
+  freeIt(it4);
+  printf("--====  End of Test-21 ====------\n\n");
+}
+  
+  
+void test22(){
+  printf("\n--====  Test-22       ====------\n");
+  IteratorG it1 = newIterator(positiveIntCompare, positiveIntNew, positiveIntFree);
+  int a[6] = {25, 78, 6, 82, 11, 4};
+  addMany(it1, a, 6, sizeof(int));
+  reset(it1);
+  CursorG c1 = newCursor(it1);
+  CursorG c2 = newCursor(it1);
+  printf("> c1 reads: ");
+  prnInt(cursorNext(c1));
+  prnInt(cursorNext(c1));
+  printf("\n> c2 reads: ");
+  prnInt(cursorNext(c2));
+  printf("\n> cursorDistanceFromStart: c1 %d, c2 %d, it1 %d \n",
+         cursorDistanceFromStart(c1), cursorDistanceFromStart(c2), distanceFromStart(it1));
+  int ok = cursorSeek(c2, 5);
+  printf("> cursorSeek(c2, 5) returns %d, then c2 reads: ", ok);
+  prnInt(cursorNext(c2));
+  printf("\n> cursorHasNext(c2) returns %d, cursorDistanceToEnd(c1) returns %d \n",
+         cursorHasNext(c2), cursorDistanceToEnd(c1));
+  printf("> c1 reads back: ");
+  prnInt(cursorPrevious(c1));
+  cursorReset(c2);
+  printf("\n> after cursorReset c2 reads: ");
+  prnInt(cursorNext(c2));
+  printf("\n");
+  prnIt(it1, prnInt);
+  freeCursor(c1);
+  freeCursor(c2);
+  freeIt(it1);
+  printf("--====  End of Test-22 ====------\n\n");
+}
+  
+  
+void test23(){
+  printf("\n--====  Test-23       ====------\n");
+  IteratorG it1 = newIteratorBackend(LIST_BACKEND, positiveIntCompare, positiveIntNew, positiveIntFree);
+  int a[5] = {25, 78, 6, 82, 11};
+  addMany(it1, a, 5, sizeof(int));
+  printf("> makeConcurrent(it1) returns %d \n", makeConcurrent(it1));
+  CursorG c1 = newCursor(it1);
+  printf("> c1 reads: ");
+  prnInt(cursorNext(c1));
+  /* the writer deletes the element just ahead of c1, which can still read it */
+  reset(it1);
+  next(it1);
+  next(it1);
+  printf("\n> del(it1) returns %d, c1 still reads: ", del(it1));
+  prnInt(cursorNext(c1));
+  printf("\n");
+  int v = 99;
+  add(it1, &v);
+  cursorReset(c1);
+  printf("> after cursorReset c1 reads: ");
+  while(cursorHasNext(c1)){
+    prnInt(cursorNext(c1));
+  }
+  printf("\n> cursorDistanceFromStart(c1) returns %d \n", cursorDistanceFromStart(c1));
+  freeCursor(c1);
+  reset(it1);
+  prnIt(it1, prnInt);
+  freeIt(it1);
+  printf("--====  End of Test-23 ====------\n\n");
+}
+  
+  
+typedef struct Producer {
+  IteratorG it;
+  int start;
+} Producer;
+
+/* stages the ints from start up to start + 999 */
+void *produce(void *arg){
+  Producer *p = arg;
+  int i;
+  for(i = 0; i < 1000; i++){
+    int v = p->start + i;
+    if(!stage(p->it, &v)) return NULL;
+  }
+  return p;
+}
+
+void test24(){
+  printf("\n--====  Test-24       ====------\n");
+  IteratorG it1 = newIterator(positiveIntCompare, positiveIntNew, positiveIntFree);
+  printf("> attachStaging(it1) returns %d \n", attachStaging(it1));
+  int a[3] = {25, 78, 6};
+  int i;
+  for(i = 0; i < 3; i++){
+    stage(it1, &a[i]);
+  }
+  printf("> drainInto(it1) returns %d, the same as adding 25, 78, 6 in turn: \n", drainInto(it1));
+  reset(it1);
+  prnIt(it1, prnInt);
+  printf("> drainInto(it1) with nothing staged returns %d \n", drainInto(it1));
+
+  /* four threads stage 1000 ints each while this one drains */
+  Producer p[4];
+  pthread_t threads[4];
+  int drained = 0;
+  for(i = 0; i < 4; i++){
+    p[i].it = it1;
+    p[i].start = i * 1000;
+    assert(pthread_create(&threads[i], NULL, produce, &p[i]) == 0);
+  }
+  drained += drainInto(it1);
+  for(i = 0; i < 4; i++){
+    void *done;
+    pthread_join(threads[i], &done);
+    assert(done != NULL);
+  }
+  drained += drainInto(it1);
+  printf("> drained %d, size(it1) is %d \n", drained, size(it1));
+  reset(it1);
+  printf("> countRange(it1, 0, 3999) returns %d, sumInts(it1) returns %lld \n", countRange(it1, 0, 3999), sumInts(it1));
+  freeIt(it1);
+  printf("--====  End of Test-24 ====------\n\n");
+}
+  
+  
+int isEven(void *vp){
+  return *(int *)vp % 2 == 0;
+}
+
+void test25(){
+  printf("\n--====  Test-25       ====------\n");
+  IteratorG it1 = newIteratorBackend(LIST_BACKEND, positiveIntCompare, positiveIntNew, positiveIntFree);
+  int a[4] = {25, 78, 6, 82};
+  int i;
+  for(i = 0; i < 4; i++){
+    add(it1, &a[i]);
+  }
+  reset(it1);
+  IteratorG found = find(it1, isEven);
+  next(it1);
+  next(it1);
+  del(it1);
+  IteratorStats st;
+  if(getIteratorStats(it1, &st)){
+    printf("> nodes allocated %lu, freed %lu, bytes in use %ld \n", st.nodesAllocated, st.nodesFreed, st.bytesInUse);
+    printf("> newElm calls %lu, freeElm calls %lu, predicate calls %lu \n", st.newCalls, st.freeCalls, st.predCalls);
+    /* find() steps through the list with next(), but only the find is timed */
+    printf("> calls to add %lu, next %lu, del %lu, find %lu \n",
+           st.calls[STAT_ADD], st.calls[STAT_NEXT], st.calls[STAT_DEL], st.calls[STAT_FIND]);
+    unsigned long timed = 0;
+    int b;
+    for(b = 0; b < STAT_BUCKETS; b++){
+      timed += st.latency[STAT_ADD][b];
+    }
+    printf("> add latency histogram holds %lu calls \n", timed);
+  }else{
+    printf("> getIteratorStats returns 0, built without -DITERATORG_STATS \n");
+    assert(st.nodesAllocated == 0 && st.calls[STAT_ADD] == 0);
+  }
+  freeIt(found);
+  freeIt(it1);
+
+  /* list nodes come from slabs, so 1000 adds take a handful of mallocs, and nodes del() frees are reused */
+  IteratorG it2 = newIteratorBackend(LIST_BACKEND, positiveIntCompare, positiveIntNew, positiveIntFree);
+  for(i = 0; i < 1000; i++){
+    add(it2, &i);
+  }
+  reset(it2);
+  for(i = 0; i < 500; i++){
+    next(it2);
+    del(it2);
+  }
+  for(i = 0; i < 500; i++){
+    add(it2, &i);
+  }
+  if(getIteratorStats(it2, &st)){
+    printf("> 1500 adds and 500 dels: nodes allocated %lu, freed %lu, node mallocs %lu \n",
+           st.nodesAllocated, st.nodesFreed, st.nodeMallocs);
+    assert(st.nodesAllocated == 1502 && st.nodeMallocs < 10);
+  }
+  freeIt(it2);
+  printf("--====  End of Test-25 ====------\n\n");
+}
+  
+  
+void test26(){
+  printf("\n--====  Test-26       ====------\n");
+  IteratorG it1 = newIterator(positiveIntCompare, positiveIntNew, positiveIntFree);
+  int a[6] = {25, 78, 6, 82, 6, 11};
+  int i;
+  for(i = 0; i < 6; i++){
+    add(it1, &a[i]);
+  }
+  /* it1 reads 11, 6, 82, 6, 78, 25, sorting mustn't copy elements or swap the two 6s */
+  reset(it1);
+  next(it1);
+  int *six = next(it1);
+  printf("> sortIt(it1) returns %d \n", sortIt(it1));
+  prnIt(it1, prnInt);
+  reset(it1);
+  printf("> the first 6 read before sorting is still first: %d \n", next(it1) == six);
+
+  /* reversed, it sorts in reading order, so reversing back reads it descending */
+  reverse(it1);
+  printf("> after reverse(it1), sortIt(it1) returns %d \n", sortIt(it1));
+  prnIt(it1, prnInt);
+  reverse(it1);
+  reset(it1);
+  prnIt(it1, prnInt);
+  freeIt(it1);
+
+  /* 100000 ints out of order, sorted and merged on 4 threads */
+  IteratorG it2 = newIterator(positiveIntCompare, positiveIntNew, positiveIntFree);
+  for(i = 0; i < 100000; i++){
+    int v = (i * 7919) % 100000;
+    add(it2, &v);
+  }
+  printf("> sortItParallel(it2, 4) returns %d \n", sortItParallel(it2, 4));
+  int inOrder = 1;
+  int prev = -1;
+  while(hasNext(it2)){
+    int v = *(int *) next(it2);
+    if(v != prev + 1) inOrder = 0;
+    prev = v;
+  }
+  printf("> it2 reads 0 to 99999 in order: %d \n", inOrder);
+  freeIt(it2);
+  printf("--====  End of Test-26 ====------\n\n");
+}
+  
+  
+void test27(){
+  printf("\n--====  Test-27       ====------\n");
+  IteratorG it1 = newIterator(positiveIntCompare, positiveIntNew, positiveIntFree);
+  int a[3] = {25, 78, 6};
+  int i;
+  int *made[3];
+  for(i = 0; i < 3; i++){
+    made[i] = positiveIntNew(&a[i]);
+    addOwned(it1, made[i]);
+  }
+  reset(it1);
+  prnIt(it1, prnInt);
+  /* the list holds the very pointers it was given, and take() hands them back */
+  reset(it1);
+  printf("> next(it1) returns the pointer given to addOwned: %d \n", next(it1) == made[2]);
+  int *taken = take(it1);
+  printf("> take(it1) returns it again: %d, size(it1) is now %d \n", taken == made[2], size(it1));
+  printf("> take(it1) with nothing before the cursor returns %s \n", take(it1) == NULL ? "NULL" : "an element");
+  positiveIntFree(taken);
+  prnIt(it1, prnInt);
+  freeIt(it1);
+
+  /* short strings go into their nodes, so addOwned frees the copy it was given and take makes a new one */
+  IteratorG it2 = newIteratorStrings(stringCompare, stringNew, stringFree);
+  addOwned(it2, stringNew("short"));
+  addOwned(it2, stringNew("a string too long to be kept in its node"));
+  reset(it2);
+  prnIt(it2, prnStr);
+  char *s;
+  while((s = take(it2)) != NULL){
+    printf("> took \"%s\" \n", s);
+    stringFree(s);
+  }
+  printf("> size(it2) is %d \n", size(it2));
+  freeIt(it2);
+
+  IteratorG it3 = newIteratorInline(sizeof(int), positiveIntCompare);
+  printf("> addOwned on an inline iterator returns %d \n", addOwned(it3, &a[0]));
+  freeIt(it3);
+
+  /* set() copies its value in like add() does, unlike addOwned, so changing the caller's int changes nothing */
+  IteratorG it4 = newIterator(positiveIntCompare, positiveIntNew, positiveIntFree);
+  int v = 40;
+  add(it4, &v);
+  next(it4);
+  v = 41;
+  printf("> set(it4, &v) returns %d \n", set(it4, &v));
+  v = 42;
+  reset(it4);
+  int *got = next(it4);
+  printf("> set(it4, &v) then v = 42, it4 holds %d, a copy of v: %d \n", *got, got != &v);
+  freeIt(it4);
+  printf("--====  End of Test-27 ====------\n\n");
+}
+  
+  
+void test28(){
+  printf("\n--====  Test-28       ====------\n");
+  IteratorBackend backends[3] = { LIST_BACKEND, UNROLLED_BACKEND, TREE_BACKEND };
+  char *names[3] = { "list", "unrolled", "tree" };
+  int a[7] = {25, 78, 6, 82, 11, 40, 3};
+  int b, i;
+  for(b = 0; b < 3; b++){
+    IteratorG it1 = newIteratorBackend(backends[b], positiveIntCompare, positiveIntNew, positiveIntFree);
+    addMany(it1, a, 7, sizeof(int));
+    printf("> %s: ", names[b]);
+    reset(it1);
+    prnIt(it1, prnInt);
+    int targets[5] = {0, 3, 7, -1, 8};
+    for(i = 0; i < 5; i++){
+      int result = seek(it1, targets[i]);
+      int index = distanceFromStart(it1);
+      void *n = next(it1);
+      printf("> seek(it1, %d) returns %d, distanceFromStart is then %d and next returns ", targets[i], result, index);
+      if(n != NULL){
+        prnInt(n);
+      }else{
+        printf("NULL");
+      }
+      printf("\n");
+    }
+    /* seeking counts from the start in reading order, so a reversed list is indexed from its other end */
+    reverse(it1);
+    seek(it1, 1);
+    printf("> after reverse(it1), seek(it1, 1), next returns ");
+    prnInt(next(it1));
+    IteratorG adv = advance(it1, 3);
+    printf(", advance(it1, 3) passes over %d elements and leaves distanceToEnd(it1) at %d \n", size(adv), distanceToEnd(it1));
+    freeIt(adv);
+    freeIt(it1);
+  }
+  printf("--====  End of Test-28 ====------\n\n");
+}
+
+void test29(){
+  printf("\n--====  Test-29       ====------\n");
+  IteratorBackend backends[3] = { LIST_BACKEND, UNROLLED_BACKEND, TREE_BACKEND };
+  char *names[3] = { "list", "unrolled", "tree" };
+  int a[6] = {25, 78, 6, 82, 11, 40};
+  int b, i;
+  for(b = 0; b < 3; b++){
+    IteratorG it1 = newIteratorBackend(backends[b], positiveIntCompare, positiveIntNew, positiveIntFree);
+    addMany(it1, a, 6, sizeof(int));
+    printf("> %s: ", names[b]);
+    reset(it1);
+    prnIt(it1, prnInt);
+    /* reverse() moves a cursor at either end to the other end, one in between stays as far from the start */
+    int starts[4] = {0, 2, 5, 6};
+    for(i = 0; i < 4; i++){
+      seek(it1, starts[i]);
+      reverse(it1);
+      int index = distanceFromStart(it1);
+      void *n = next(it1);
+      printf("> reverse(it1) at index %d leaves it at index %d, next returns ", starts[i], index);
+      if(n != NULL){
+        prnInt(n);
+      }else{
+        printf("NULL");
+      }
+      printf("\n");
+      assert(index == ((starts[i] == 0 || starts[i] == 6) ? 6 - starts[i] : starts[i]));
+    }
+    freeIt(it1);
+  }
+  /* the typed iterator of iteratorT.h moves its cursor the same way */
+  IntIterator* it2 = IntIterator_new();
+  for(i = 0; i < 6; i++){
+    IntIterator_add(it2, a[i]);
+  }
+  int starts[4] = {0, 2, 5, 6};
+  for(i = 0; i < 4; i++){
+    IntIterator_reset(it2);
+    while(IntIterator_distanceFromStart(it2) < starts[i]){
+      IntIterator_next(it2);
+    }
+    IntIterator_reverse(it2);
+    int index = IntIterator_distanceFromStart(it2);
+    int *n = IntIterator_next(it2);
+    printf("> IntIterator_reverse(it2) at index %d leaves it at index %d, next returns ", starts[i], index);
+    if(n != NULL){
+      prnInt(n);
+    }else{
+      printf("NULL");
+    }
+    printf("\n");
+    assert(index == ((starts[i] == 0 || starts[i] == 6) ? 6 - starts[i] : starts[i]));
+  }
+  IntIterator_free(it2);
+  printf("--====  End of Test-29 ====------\n\n");
+}
+
+void test30(){
+  printf("\n--====  Test-30       ====------\n");
+  IteratorG it1 = newIterator(positiveIntCompare, positiveIntNew, positiveIntFree);
+  printf("> size(it1) of a new iterator is %d \n", size(it1));
+  int a[6] = {25, 78, 6, 82, 11, 40};
+  int i;
+  for(i = 0; i < 4; i++){
+    add(it1, &a[i]);
+  }
+  addMany(it1, a + 4, 2, sizeof(int));
+  printf("> after 4 adds and addMany of 2, size(it1) is %d \n", size(it1));
+  reset(it1);
+  next(it1);
+  del(it1);
+  printf("> after del(it1), size(it1) is %d \n", size(it1));
+  reset(it1);
+  int result = del(it1);
+  printf("> del(it1) with nothing before the cursor returns %d and leaves size(it1) at %d \n", result, size(it1));
+  assert(size(it1) == 5);
+
+  /* views count only what they cover, and reading them doesn't change their size */
+  IteratorG adv = advance(it1, 3);
+  printf("> advance(it1, 3) has size %d, ", size(adv));
+  next(adv);
+  printf("still %d after next(adv), and size(it1) is still %d \n", size(adv), size(it1));
+  /* filter and find start at it1's cursor, which advance left before 78, 25 */
+  IteratorG filt = filter(it1, passMarks);
+  printf("> filter(it1, passMarks) has size %d, ", size(filt));
+  IteratorG found = find(it1, passMarks);
+  printf("find(it1, passMarks) has size %d \n", size(found));
+  freeIt(filt);
+  freeIt(found);
+  materialize(adv);
+  add(adv, &a[0]);
+  printf("> a materialized advance(it1, 3) after one add has size %d, size(it1) is %d \n", size(adv), size(it1));
+  freeIt(adv);
+  freeIt(it1);
+  printf("--====  End of Test-30 ====------\n\n");
+}
   
   
 int main(int argc, char *argv[])
@@ -572,6 +1542,14 @@ int main(int argc, char *argv[])
      the file 'expected_output.txt'.
   */
   
+  /* "./testIteratorG unrolled" and "./testIteratorG tree" run the same tests on the other backends */
+  if(argc > 1 && strcmp(argv[1], "unrolled") == 0){
+    setDefaultBackend(UNROLLED_BACKEND);
+  }
+  if(argc > 1 && strcmp(argv[1], "tree") == 0){
+    setDefaultBackend(TREE_BACKEND);
+  }
+  
   test1();
   test2();
   test3();
@@ -580,6 +1558,28 @@ int main(int argc, char *argv[])
   test6();
   test7();
   test8();
+  test9();
+  test10();
+  test11();
+  test12();
+  test13();
+  test14();
+  test15();
+  test16();
+  test17();
+  test18();
+  test19();
+  test20();
+  test21();
+  test22();
+  test23();
+  test24();
+  test25();
+  test26();
+  test27();
+  test28();
+  test29();
+  test30();
   
   return EXIT_SUCCESS;
   